@@ -0,0 +1,680 @@
+#include <benchmark/benchmark.h>
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <array>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <cstring>
+#include <new>
+#include <string>
+#include <thread>
+
+#include "async_backend.h"
+#include "compressed_file_sink.h"
+#include "console_sink.h"
+#include "desktop_provider.h"
+#include "logger.h"
+#include "logger_registry.h"
+#include "metrics_sink.h"
+#include "socket_sink.h"
+#include "uring_file_sink.h"
+
+/**
+ * Counts heap allocations and system calls made by logging calls. Allocation functions, `write`,
+ * `writev`, `fwrite`, clock functions and `syscall(SYS_gettid)` are replaced in this executable,
+ * so calls from the logger headers and from libstdc++ come here first. Calls are counted only in
+ * thread that measures, inside `Counting` scope, so background threads of async backend and
+ * sinks, and benchmark library are not counted.
+ *
+ * Every benchmark logs one message per iteration after warm-up call, that fills call site caches
+ * and thread local queues, and fails if counts per call differ from expected ones for its provider,
+ * sink and mode. Benchmarks of thread state count the first call of a new thread instead, without
+ * warm-up, only after `prepareThread` that is the hook allowed to allocate. Counts are reported
+ * next to timings, the program exits with 1 on mismatch.
+ */
+
+namespace Accounting {
+
+struct Counts {
+    size_t allocs = 0;
+    size_t writes = 0;
+    size_t clocks = 0;
+    size_t gettids = 0;
+};
+
+thread_local Counts counts;
+thread_local bool enabled = false;
+/// set while stdout is unbuffered, every `fwrite` to it is one `write` then
+bool unbuffered_stdout = false;
+
+/// enables counting in calling thread
+class Counting {
+public:
+    Counting() { enabled = true; }
+    ~Counting() { enabled = false; }
+};
+
+template <typename T>
+T real(const char *name) {
+    return reinterpret_cast<T>(dlsym(RTLD_NEXT, name));
+}
+
+bool failed = false;
+
+/**
+ * @brief firstCalls
+ * @param prepare preparation of new thread, not counted
+ * @param call logging call counted in new thread
+ *
+ * Makes every iteration in new thread and adds counts of its first call to calling thread
+ */
+template <typename TPrepare, typename TCall>
+void firstCalls(benchmark::State &state, const TPrepare &prepare, const TCall &call) {
+    for (auto _ : state) {
+        Counts measured;
+        std::thread([&] {
+            prepare();
+            {
+                Counting counting;
+                call();
+            }
+            measured = counts;
+        }).join();
+        counts.allocs += measured.allocs;
+        counts.writes += measured.writes;
+        counts.clocks += measured.clocks;
+        counts.gettids += measured.gettids;
+    }
+}
+
+/**
+ * @brief check
+ * @param expected counts of one logging call
+ *
+ * Reports counts per call as benchmark counters and fails benchmark if they differ from expected
+ */
+void check(benchmark::State &state, const Counts &expected) {
+    const auto calls = static_cast<size_t>(state.iterations());
+    const Counts measured = counts;
+    counts = Counts();
+
+    state.counters["allocs"] = static_cast<double>(measured.allocs) / calls;
+    state.counters["writes"] = static_cast<double>(measured.writes) / calls;
+    state.counters["clocks"] = static_cast<double>(measured.clocks) / calls;
+    state.counters["gettids"] = static_cast<double>(measured.gettids) / calls;
+
+    if (measured.allocs != expected.allocs * calls || measured.writes != expected.writes * calls ||
+        measured.clocks != expected.clocks * calls ||
+        measured.gettids != expected.gettids * calls) {
+        failed = true;
+        state.SkipWithError("hot path counts differ from expected");
+    }
+}
+
+}  // namespace Accounting
+
+extern "C" {
+
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+void __libc_free(void *ptr);
+
+void *malloc(size_t size) {
+    Accounting::counts.allocs += Accounting::enabled;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+    Accounting::counts.allocs += Accounting::enabled;
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    Accounting::counts.allocs += Accounting::enabled;
+    return __libc_realloc(ptr, size);
+}
+
+void *memalign(size_t alignment, size_t size) {
+    Accounting::counts.allocs += Accounting::enabled;
+    return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+    Accounting::counts.allocs += Accounting::enabled;
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size) {
+    Accounting::counts.allocs += Accounting::enabled;
+    *ptr = __libc_memalign(alignment, size);
+    return *ptr != nullptr ? 0 : ENOMEM;
+}
+
+void free(void *ptr) { __libc_free(ptr); }
+
+ssize_t write(int fd, const void *buf, size_t count) {
+    static const auto next = Accounting::real<ssize_t (*)(int, const void *, size_t)>("write");
+    Accounting::counts.writes += Accounting::enabled;
+    return next(fd, buf, count);
+}
+
+// `write` made by stdio inside libc does not come here, unbuffered stdout is counted by `fwrite`
+size_t fwrite(const void *ptr, size_t size, size_t count, FILE *stream) {
+    static const auto next =
+        Accounting::real<size_t (*)(const void *, size_t, size_t, FILE *)>("fwrite");
+    Accounting::counts.writes +=
+        Accounting::enabled && Accounting::unbuffered_stdout && stream == stdout;
+    return next(ptr, size, count, stream);
+}
+
+ssize_t writev(int fd, const struct iovec *iov, int iovcnt) {
+    static const auto next = Accounting::real<ssize_t (*)(int, const iovec *, int)>("writev");
+    Accounting::counts.writes += Accounting::enabled;
+    return next(fd, iov, iovcnt);
+}
+
+int clock_gettime(clockid_t clock, struct timespec *tp) {
+    static const auto next = Accounting::real<int (*)(clockid_t, timespec *)>("clock_gettime");
+    Accounting::counts.clocks += Accounting::enabled;
+    return next(clock, tp);
+}
+
+int gettimeofday(struct timeval *tv, void *tz) {
+    static const auto next = Accounting::real<int (*)(timeval *, void *)>("gettimeofday");
+    Accounting::counts.clocks += Accounting::enabled;
+    return next(tv, tz);
+}
+
+time_t time(time_t *tloc) {
+    static const auto next = Accounting::real<time_t (*)(time_t *)>("time");
+    Accounting::counts.clocks += Accounting::enabled;
+    return next(tloc);
+}
+
+long syscall(long number, ...) {
+    using Syscall = long (*)(long, long, long, long, long, long, long);
+    static const auto next = Accounting::real<Syscall>("syscall");
+    std::array<long, 6> args;
+    va_list list;
+    va_start(list, number);
+    for (long &arg : args) {
+        arg = va_arg(list, long);
+    }
+    va_end(list);
+    Accounting::counts.gettids += Accounting::enabled && number == SYS_gettid;
+    return next(number, args[0], args[1], args[2], args[3], args[4], args[5]);
+}
+
+}  // extern "C"
+
+// operator new of libstdc++ calls `malloc`, it is replaced to count allocations of this
+// executable in the same way
+void *operator new(size_t size) {
+    void *ptr = std::malloc(size);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void *operator new[](size_t size) { return operator new(size); }
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+
+void operator delete[](void *ptr) noexcept { std::free(ptr); }
+
+void operator delete(void *ptr, size_t) noexcept { std::free(ptr); }
+
+void operator delete[](void *ptr, size_t) noexcept { std::free(ptr); }
+
+class NullSink : public Log::ILogSink<NullSink> {
+public:
+    void sendImpl(const Log::level, const char *, size_t) const {}
+};
+
+/// writes every message to /dev/null with one `write`
+class FdSink : public Log::ILogSink<FdSink> {
+public:
+    FdSink()
+        : fd(open("/dev/null", O_WRONLY)) {}
+
+    void sendImpl(const Log::level, const char *data, size_t size) const {
+        if (::write(fd, data, size) < 0) {
+            return;
+        }
+    }
+
+private:
+    int fd;
+};
+
+/// provider without clock and system calls
+class BenchContext : public Log::IContextProvider<BenchContext> {
+public:
+    long long getTimestampImpl() const { return 0; }
+    size_t getProcessNameImpl(char *, size_t) const { return 0; }
+    size_t getThreadIdImpl(char *, size_t) const { return 0; }
+    size_t getCurrentDateImpl(char *, size_t) const { return 0; }
+    size_t formatTimeImpl(char *, size_t, long) const { return 0; }
+};
+
+struct SpillTag {};
+template <>
+struct Log::Config::Traits<SpillTag> : Log::Config::BaseTraits {
+    static constexpr bool ENABLE_PAYLOAD_SPILL = true;
+};
+
+struct FieldsTag {};
+template <>
+struct Log::Config::Traits<FieldsTag> : Log::Config::BaseTraits {
+    static constexpr size_t LOGGER_MAX_FIELDS = 4;
+    static constexpr size_t LOGGER_FIELDS_BUFFER_SIZE = 64;
+};
+
+struct SpanTag {};
+template <>
+struct Log::Config::Traits<SpanTag> : Log::Config::BaseTraits {
+    static constexpr Log::level LOGGER_SPAN_LEVEL = Log::level::InfoMsg;
+};
+
+struct AsyncTag {};
+template <>
+struct Log::Config::Traits<AsyncTag> : Log::Config::BaseTraits {
+    static constexpr bool ENABLE_ASYNC = true;
+};
+
+static constexpr const char *site_pattern =
+    "%{level} %{file_base}:%{line} %{func_short} %{message}";
+
+static void BM_SyncNullSink(benchmark::State &state) {
+    const BenchContext context;
+    Log::Logger logger(context, NullSink());
+    logger.setLogLevel(Log::level::DebugMsg);
+    logger.setLogPattern(site_pattern);
+
+    auto call = [&](int i) { Info(logger, "value {} of {} {:x}\n", i, "test", 0xbeef); };
+    call(0);
+    for (auto _ : state) {
+        Accounting::Counting counting;
+        call(1);
+    }
+    Accounting::check(state, {0, 0, 0, 0});
+}
+
+BENCHMARK(BM_SyncNullSink);
+
+static void BM_SyncFdSink(benchmark::State &state) {
+    const BenchContext context;
+    Log::Logger logger(context, FdSink());
+    logger.setLogLevel(Log::level::DebugMsg);
+    logger.setLogPattern(site_pattern);
+
+    auto call = [&](int i) { Info(logger, "value {} of {} {:x}\n", i, "test", 0xbeef); };
+    call(0);
+    for (auto _ : state) {
+        Accounting::Counting counting;
+        call(1);
+    }
+    Accounting::check(state, {0, 1, 0, 0});
+}
+
+BENCHMARK(BM_SyncFdSink);
+
+static void BM_SyncDesktopContext(benchmark::State &state) {
+    const DesktopContext context;
+    Log::Logger logger(context, NullSink());
+    logger.setLogLevel(Log::level::DebugMsg);
+    logger.setLogPattern("%{date} %{time} [%{thread}] %{level} %{message}");
+
+    auto call = [&](int i) { Info(logger, "value {} of {}\n", i, "test"); };
+    call(0);
+    for (auto _ : state) {
+        Accounting::Counting counting;
+        call(1);
+    }
+    // timestamp and "%{date}" read clock, "%{thread}" asks kernel for thread id
+    Accounting::check(state, {0, 0, 2, 1});
+}
+
+BENCHMARK(BM_SyncDesktopContext);
+
+static void BM_SyncJsonFields(benchmark::State &state) {
+    const BenchContext context;
+    Log::Logger<BenchContext, FieldsTag, NullSink> logger(context, NullSink());
+    logger.setLogLevel(Log::level::DebugMsg);
+    logger.setLogPattern("%{json}");
+
+    auto call = [&](int i) {
+        Info(logger, "request {} done\n", i, Log::kv("user", "alice"), Log::kv("ms", 12.5));
+    };
+    call(0);
+    for (auto _ : state) {
+        Accounting::Counting counting;
+        call(1);
+    }
+    Accounting::check(state, {0, 0, 0, 0});
+}
+
+BENCHMARK(BM_SyncJsonFields);
+
+static void BM_SyncSpilledPayload(benchmark::State &state) {
+    const BenchContext context;
+    Log::Logger<BenchContext, SpillTag, NullSink> logger(context, NullSink());
+    logger.setLogLevel(Log::level::DebugMsg);
+    logger.setLogPattern("%{json}");
+    const std::string payload(1000, 'x');
+
+    // arena is allocated by `prepareThread`, never by the first spilled message
+    Accounting::firstCalls(
+        state, [&]() { logger.prepareThread(); },
+        [&]() { Info(logger, "payload {}\n", payload); });
+    Accounting::check(state, {0, 0, 0, 0});
+}
+
+BENCHMARK(BM_SyncSpilledPayload);
+
+static void BM_FirstCallDesktopContext(benchmark::State &state) {
+    const DesktopContext context;
+    Log::Logger logger(context, NullSink());
+    logger.setLogLevel(Log::level::DebugMsg);
+    logger.setLogPattern("%{date} %{time} [%{thread}] %{level} %{message}");
+
+    // time zone is loaded by provider constructor, not by the first local time conversion
+    Accounting::firstCalls(
+        state, [&]() { logger.prepareThread(); },
+        [&]() { Info(logger, "value {} of {}\n", 1, "test"); });
+    Accounting::check(state, {0, 0, 2, 1});
+}
+
+BENCHMARK(BM_FirstCallDesktopContext);
+
+static void BM_SyncHexDump(benchmark::State &state) {
+    const BenchContext context;
+    Log::Logger logger(context, NullSink());
+    logger.setLogLevel(Log::level::DebugMsg);
+    logger.setLogPattern(site_pattern);
+    std::array<unsigned char, 48> frame = {};
+
+    auto call = [&]() { LogBytes(logger, Log::level::InfoMsg, "rx", frame.data(), frame.size()); };
+    call();
+    for (auto _ : state) {
+        Accounting::Counting counting;
+        call();
+    }
+    Accounting::check(state, {0, 0, 0, 0});
+}
+
+BENCHMARK(BM_SyncHexDump);
+
+static void BM_Span(benchmark::State &state) {
+    const BenchContext context;
+    Log::Logger<BenchContext, SpanTag, NullSink> logger(context, NullSink());
+    logger.setLogLevel(Log::level::DebugMsg);
+    logger.setLogPattern(site_pattern);
+
+    auto call = [&]() { LOG_SCOPE(logger, "step"); };
+    call();
+    for (auto _ : state) {
+        Accounting::Counting counting;
+        call();
+    }
+    // span begin and end
+    Accounting::check(state, {0, 0, 2, 0});
+}
+
+BENCHMARK(BM_Span);
+
+static void BM_RecordsOnly(benchmark::State &state) {
+    const BenchContext context;
+    Log::Logger logger(context, Log::MetricsSink());
+    logger.setLogLevel(Log::level::DebugMsg);
+
+    auto call = [&](int i) { Info(logger, "value {}\n", i); };
+    call(0);
+    for (auto _ : state) {
+        Accounting::Counting counting;
+        call(1);
+    }
+    Accounting::check(state, {0, 0, 0, 0});
+}
+
+BENCHMARK(BM_RecordsOnly);
+
+static void BM_AsyncFdSink(benchmark::State &state) {
+    const BenchContext context;
+    Log::Logger<BenchContext, AsyncTag, FdSink> logger(context, FdSink());
+    logger.setLogLevel(Log::level::DebugMsg);
+    logger.setLogPattern(site_pattern);
+    Log::AsyncBackend backend(logger);
+
+    auto call = [&](int i) { Info(logger, "value {} of {} {:x}\n", i, "test", 0xbeef); };
+    call(0);
+    for (auto _ : state) {
+        Accounting::Counting counting;
+        call(1);
+    }
+    // sink writes in background thread, INFO message is dropped if queue is full, so caller never
+    // waits for free slot
+    Accounting::check(state, {0, 0, 0, 0});
+}
+
+BENCHMARK(BM_AsyncFdSink);
+
+static void BM_RegistryFrontEnd(benchmark::State &state) {
+    const BenchContext context;
+    Log::Registry<Log::Logger<BenchContext, Log::Config::Default, NullSink>> registry(context,
+                                                                                    NullSink());
+    registry.setDefaultLogLevel(Log::level::DebugMsg);
+    registry.setDefaultLogPattern("[%{logger}] %{level} %{message}");
+    auto *logger = registry.get("net");
+    if (logger == nullptr) {
+        state.SkipWithError("registry is full");
+        return;
+    }
+    auto &net = *logger;
+
+    auto call = [&](int i) { Info(net, "value {}\n", i); };
+    call(0);
+    for (auto _ : state) {
+        Accounting::Counting counting;
+        call(1);
+    }
+    Accounting::check(state, {0, 0, 0, 0});
+}
+
+BENCHMARK(BM_RegistryFrontEnd);
+
+/// sends stdout to /dev/null unbuffered, so every message of console sink is one `write`
+class QuietStdout {
+public:
+    QuietStdout() {
+        std::fflush(stdout);
+        saved = dup(STDOUT_FILENO);
+        const int null_fd = open("/dev/null", O_WRONLY);
+        dup2(null_fd, STDOUT_FILENO);
+        close(null_fd);
+        std::setvbuf(stdout, nullptr, _IONBF, 0);
+        Accounting::unbuffered_stdout = true;
+    }
+
+    ~QuietStdout() {
+        Accounting::unbuffered_stdout = false;
+        std::fflush(stdout);
+        dup2(saved, STDOUT_FILENO);
+        close(saved);
+        std::setvbuf(stdout, nullptr, isatty(STDOUT_FILENO) ? _IOLBF : _IOFBF, BUFSIZ);
+    }
+
+private:
+    int saved;
+};
+
+static void BM_SyncConsoleSink(benchmark::State &state) {
+    const BenchContext context;
+    Log::Logger logger(context, ConsoleSink());
+    logger.setLogLevel(Log::level::DebugMsg);
+    logger.setLogPattern(site_pattern);
+    QuietStdout quiet;
+
+    auto call = [&](int i) { Info(logger, "value {} of {} {:x}\n", i, "test", 0xbeef); };
+    call(0);
+    for (auto _ : state) {
+        Accounting::Counting counting;
+        call(1);
+    }
+    // colored message is printed with one `write` of unbuffered stdout
+    Accounting::check(state, {0, 1, 0, 0});
+}
+
+BENCHMARK(BM_SyncConsoleSink);
+
+/// log file of benchmark, removed with its index
+class TempLog {
+public:
+    explicit TempLog(const char *name)
+        : path("/tmp/logger_hot_path_" + std::to_string(getpid()) + "_" + name) {}
+
+    ~TempLog() {
+        std::remove(path.c_str());
+        std::remove(Log::Index::indexPath(path).c_str());
+    }
+
+    const std::string path;
+};
+
+static void BM_SyncCompressedFileSink(benchmark::State &state) {
+    const BenchContext context;
+    const TempLog file("compressed.clog");
+    Log::CompressedFileSink::Options options;
+    options.write_index = true;
+    Log::Logger logger(context, Log::CompressedFileSink(file.path, options));
+    logger.setLogLevel(Log::level::DebugMsg);
+    logger.setLogPattern(site_pattern);
+
+    auto call = [&](int i) { Info(logger, "value {} of {} {:x}\n", i, "test", 0xbeef); };
+    call(0);
+    for (auto _ : state) {
+        Accounting::Counting counting;
+        call(1);
+    }
+    // message is rendered in block buffer, blocks are compressed and written in background thread
+    Accounting::check(state, {0, 0, 0, 0});
+}
+
+BENCHMARK(BM_SyncCompressedFileSink);
+
+static void BM_SyncUringFileSink(benchmark::State &state) {
+    const BenchContext context;
+    const TempLog file("uring.log");
+    Log::UringFileSink::Options options;
+    options.write_index = true;
+    Log::Logger logger(context, Log::UringFileSink(file.path, options));
+    logger.setLogLevel(Log::level::DebugMsg);
+    logger.setLogPattern(site_pattern);
+
+    auto call = [&](int i) { Info(logger, "value {} of {} {:x}\n", i, "test", 0xbeef); };
+    call(0);
+    for (auto _ : state) {
+        Accounting::Counting counting;
+        call(1);
+    }
+    // buffers are written in background thread, with io_uring or `pwritev`
+    Accounting::check(state, {0, 0, 0, 0});
+}
+
+BENCHMARK(BM_SyncUringFileSink);
+
+/// accepts connection of socket sink and reads it until sink closes it
+class Collector {
+public:
+    explicit Collector(const char *name)
+        : path("/tmp/logger_hot_path_" + std::to_string(getpid()) + "_" + name) {
+        listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+        if (bind(listen_fd, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) != 0 ||
+            listen(listen_fd, 1) != 0) {
+            return;
+        }
+        reader = std::thread([this] {
+            const int fd = accept(listen_fd, nullptr, nullptr);
+            if (fd < 0) {
+                return;
+            }
+            std::array<char, 64 * 1024> buf;
+            while (read(fd, buf.data(), buf.size()) > 0) {
+            }
+            close(fd);
+        });
+    }
+
+    ~Collector() {
+        // wakes `accept` if sink never connected
+        shutdown(listen_fd, SHUT_RDWR);
+        if (reader.joinable()) {
+            reader.join();
+        }
+        close(listen_fd);
+        unlink(path.c_str());
+    }
+
+    const std::string path;
+
+private:
+    int listen_fd = -1;
+    std::thread reader;
+};
+
+static void BM_SyncUnixSocketSink(benchmark::State &state) {
+    const BenchContext context;
+    // destroyed after sink, that closes connection
+    const Collector collector("socket");
+    // sink is a handle, this copy tells when the one of logger is connected
+    const Log::UnixSocketSink sink(collector.path);
+    Log::Logger logger(context, sink);
+    logger.setLogLevel(Log::level::DebugMsg);
+    logger.setLogPattern(site_pattern);
+
+    auto call = [&](int i) { Info(logger, "value {} of {} {:x}\n", i, "test", 0xbeef); };
+    call(0);
+    // sink connects in background once it has data
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (!sink.connected()) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            state.SkipWithError("socket sink did not connect");
+            return;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    for (auto _ : state) {
+        Accounting::Counting counting;
+        call(1);
+    }
+    // message is rendered in ring buffer and sent in background thread, dropped if ring is full
+    Accounting::check(state, {0, 0, 0, 0});
+}
+
+BENCHMARK(BM_SyncUnixSocketSink);
+
+int main(int argc, char *argv[]) {
+    ::benchmark::Initialize(&argc, argv);
+    if (::benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+
+    ::benchmark::RunSpecifiedBenchmarks();
+    ::benchmark::Shutdown();
+
+    return Accounting::failed ? 1 : 0;
+}
@@ -0,0 +1,158 @@
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <string_view>
+
+#include "logger.h"
+#include "default_provider.h"
+// after logger, that sets how fmt reports errors
+#include "fmt/format.h"
+
+namespace {
+
+/// formats with fast formatter, fails test if it leaves format string to fmt
+template <typename... Args>
+std::string fastFormat(std::string_view format, const Args &...args) {
+    std::array<char, 256> buf;
+    const size_t len = Log::Fast::formatTo(buf.data(), buf.size(), format, args...);
+    EXPECT_NE(len, Log::Fast::unsupported) << format;
+    if (len == Log::Fast::unsupported) {
+        return std::string();
+    }
+    return std::string(buf.data(), std::min(len, buf.size()));
+}
+
+template <typename... Args>
+void expectSameAsFmt(std::string_view format, const Args &...args) {
+    EXPECT_EQ(fastFormat(format, args...), fmt::format(fmt::runtime(format), args...)) << format;
+}
+
+template <typename T>
+void expectIntegerSameAsFmt() {
+    for (T value : {std::numeric_limits<T>::min(), static_cast<T>(0), static_cast<T>(7),
+                    static_cast<T>(99), static_cast<T>(100), std::numeric_limits<T>::max()}) {
+        expectSameAsFmt("{}", value);
+        expectSameAsFmt("{:x} {:X} {:#x} {:#X}", value, value, value, value);
+    }
+}
+
+}  // namespace
+
+TEST(FastFormat, IntegersMatchFmt) {
+    expectIntegerSameAsFmt<signed char>();
+    expectIntegerSameAsFmt<unsigned char>();
+    expectIntegerSameAsFmt<short>();
+    expectIntegerSameAsFmt<unsigned short>();
+    expectIntegerSameAsFmt<int>();
+    expectIntegerSameAsFmt<unsigned>();
+    expectIntegerSameAsFmt<long>();
+    expectIntegerSameAsFmt<unsigned long>();
+    expectIntegerSameAsFmt<long long>();
+    expectIntegerSameAsFmt<unsigned long long>();
+    for (uint64_t value = 1; value != 0; value *= 10) {
+        expectSameAsFmt("{} {}", value - 1, value);
+    }
+}
+
+TEST(FastFormat, FloatsMatchFmt) {
+    for (double value : {0.0, -0.0, 1.0, -1.5, 0.1, 12.5, 1e-7, 123456789.125, 1e21, 1e300,
+                         std::numeric_limits<double>::min(), std::numeric_limits<double>::max(),
+                         std::numeric_limits<double>::infinity(),
+                         std::numeric_limits<double>::quiet_NaN()}) {
+        expectSameAsFmt("{}", value);
+        expectSameAsFmt("{}", static_cast<float>(value));
+    }
+}
+
+TEST(FastFormat, OtherTypesMatchFmt) {
+    const int value = 0;
+    const std::string text = "string";
+    expectSameAsFmt("{} {} {}", true, false, 'c');
+    expectSameAsFmt("{} {} {}", "literal", std::string_view("view"), text);
+    expectSameAsFmt("{} {} {}", static_cast<const void *>(&value), nullptr,
+                    static_cast<const void *>(nullptr));
+    expectSameAsFmt("{{escaped}} {} }}{{", 1);
+}
+
+TEST(FastFormat, LengthIsCountedPastBufferEnd) {
+    std::array<char, 4> buf;
+    EXPECT_EQ(Log::Fast::formatTo(buf.data(), buf.size(), "{} {}", 123456, "abc"), 10U);
+    EXPECT_EQ(std::string_view(buf.data(), buf.size()), "1234");
+}
+
+TEST(FastFormat, UnsupportedFieldsAreLeftToFmt) {
+    std::array<char, 32> buf;
+    EXPECT_EQ(Log::Fast::formatTo(buf.data(), buf.size(), "{:>8}", 1), Log::Fast::unsupported);
+    EXPECT_EQ(Log::Fast::formatTo(buf.data(), buf.size(), "{0}", 1), Log::Fast::unsupported);
+    EXPECT_EQ(Log::Fast::formatTo(buf.data(), buf.size(), "{:.2f}", 1.0), Log::Fast::unsupported);
+}
+
+namespace {
+
+/// appends every message to a string
+class StringSink : public Log::ILogSink<StringSink> {
+public:
+    explicit StringSink(std::string *text)
+        : out(text) {}
+
+    void sendImpl(const Log::level, const char *data, size_t size) const {
+        out->append(data, size);
+    }
+
+private:
+    std::string *out;
+};
+
+/// provider without clock and process data
+class TestContext : public Log::IContextProvider<TestContext> {
+public:
+    long long getTimestampImpl() const { return 0; }
+    size_t getProcessNameImpl(char *, size_t) const { return 0; }
+    size_t getThreadIdImpl(char *, size_t) const { return 0; }
+    size_t getCurrentDateImpl(char *, size_t) const { return 0; }
+    size_t formatTimeImpl(char *, size_t, long) const { return 0; }
+};
+
+struct SiteCacheTag {};
+
+}  // namespace
+
+template <>
+struct Log::Config::Traits<SiteCacheTag> : Log::Config::BaseTraits {
+    static constexpr bool ENABLE_SITE_CACHE = true;
+};
+
+TEST(SiteCache, LogBytesSiteRendersLevelOfEveryCall) {
+    std::string text;
+    const TestContext context;
+    Log::Logger<TestContext, SiteCacheTag, StringSink> logger(context, StringSink(&text));
+    logger.setLogLevel(Log::level::DebugMsg);
+    logger.setLogPattern("%{level} %{message}");
+    const std::array<unsigned char, 4> blob = {'a', 'b', 'c', 'd'};
+
+    for (Log::level lev : {Log::level::ErrorMsg, Log::level::WarningMsg, Log::level::ErrorMsg}) {
+        LogBytes(logger, lev, "x", blob.data(), blob.size());
+    }
+    EXPECT_EQ(text,
+              "ERROR x (4 bytes)\n00000000  61 62 63 64                                       "
+              "|abcd|\n"
+              "WARN x (4 bytes)\n00000000  61 62 63 64                                       "
+              "|abcd|\n"
+              "ERROR x (4 bytes)\n00000000  61 62 63 64                                       "
+              "|abcd|\n");
+}
+
+TEST(HexDump, ArgumentIsCappedAndRestIsCounted) {
+    std::array<unsigned char, 100> blob = {};
+    const Log::HexDump dump = Log::hexdump(blob.data(), blob.size());
+    EXPECT_EQ(dump.size, Log::Config::BaseTraits::LOGGER_MAX_DUMP_SIZE);
+    EXPECT_EQ(dump.total, blob.size());
+
+    const std::string text = fmt::format("{}", Log::hexdump(blob.data(), blob.size(), 16));
+    EXPECT_EQ(text,
+              "\n00000000  00 00 00 00 00 00 00 00  00 00 00 00 00 00 00 00  |................|"
+              "\n... 84 more bytes");
+}
@@ -0,0 +1,645 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "logger.h"
+#include "spsc_queue.h"
+#include "overflow_queue.h"
+
+namespace Log {
+
+/**
+ * @brief The AsyncBackend class
+ *
+ * Moves rendering and sink calls of `TLogger` to background thread. Every producer thread gets its
+ * own `SpscQueue`, so producers never share cache lines with each other. Messages are formatted
+ * directly in free queue slot. Background thread merges
+ * queue heads by `LogMessage::timestamp` with min-heap: the oldest message is written once every
+ * producer has pending message or once `LOGGER_REORDER_WINDOW_US` passed since background thread
+ * first saw it in queue. Output is ordered by time across threads within this window. Queue of
+ * thread that ended is released for a new thread after it is drained.
+ *
+ * When producer queue is full, `LOGGER_QUEUE_POLICY` of message level decides what happens with
+ * it. Every dropped message is counted and reported in output as "N messages dropped" line.
+ *
+ * More loggers of the same type can share queues and background thread, @see attach. Every
+ * message is rendered by logger that captured it.
+ *
+ * Tokens requested from context provider during rendering ("%{thread}", "%{date}") describe
+ * background thread. Call `stop()` or destroy backend only after producers are done logging.
+ */
+template <typename TLogger>
+class AsyncBackend {
+public:
+    using TConfig = typename TLogger::TConfig;
+    using TMessage = typename TLogger::TMessage;
+    using TQueue = SpscQueue<TConfig>;
+    using TOverflowQueue = OverflowQueue<TConfig>;
+
+    static_assert(TConfig::ENABLE_ASYNC, "AsyncBackend requires ENABLE_ASYNC in logger traits");
+
+    explicit AsyncBackend(TLogger &logger)
+        : logger_instance(logger) {
+        {
+            std::lock_guard<std::mutex> lock(liveMutex());
+            liveBackends().push_back(this);
+        }
+        worker = std::thread(&AsyncBackend::run, this);
+        attach(logger_instance);
+    }
+
+    AsyncBackend(const AsyncBackend &) = delete;
+    AsyncBackend &operator=(const AsyncBackend &) = delete;
+    AsyncBackend(AsyncBackend &&) = delete;
+    AsyncBackend &operator=(AsyncBackend &&) = delete;
+
+    ~AsyncBackend() {
+        stop();
+        std::lock_guard<std::mutex> lock(liveMutex());
+        auto &live = liveBackends();
+        live.erase(std::find(live.begin(), live.end(), this));
+    }
+
+    /**
+     * @brief prepareThread
+     * @return false if there is no free producer queue or thread state could not be allocated
+     *
+     * Registers calling thread ahead of its first message and prepares it for logging, @see
+     * Logger::prepareThread. Registration sets up thread local state, which may allocate, call it
+     * at thread start to keep it out of logging calls.
+     */
+    bool prepareThread() { return localProducer() != nullptr && logger_instance.prepareThread(); }
+
+    /**
+     * @brief submit
+     * @param msg captured message
+     * @return false if message was dropped because queue is full or there is no free queue
+     *
+     * Places message in queue of calling thread. Registers calling thread on first use.
+     * Applies `LOGGER_QUEUE_POLICY` if queue is full. While earlier messages of thread wait in
+     * overflow queue, next ones follow them there, so thread keeps its order.
+     */
+    bool submit(const TMessage &msg) {
+        Producer *producer = localProducer();
+        if (producer == nullptr) {
+            orphan_dropped.fetch_add(1, std::memory_order_relaxed);
+            msg.releaseSpill();
+            return false;
+        }
+
+        const bool spilled = spilling(*producer);
+        if (spilled ? spill(*producer, msg) : push(*producer, msg)) {
+            return true;
+        }
+
+        bool placed = false;
+        switch (TConfig::LOGGER_QUEUE_POLICY[static_cast<size_t>(msg.record.msgType)]) {
+            case queuePolicy::Block:
+                placed = retry([&] {
+                    return spilled ? spill(*producer, msg) : push(*producer, msg);
+                });
+                break;
+            case queuePolicy::DropNewest:
+                break;
+            case queuePolicy::DropOldest: {
+                TMessage dropped;
+                if (!spilled && producer->queue.dropOldest(dropped)) {
+                    dropped.releaseSpill();
+                    producer->countDropped();
+                    placed = push(*producer, msg);
+                }
+                break;
+            }
+            case queuePolicy::Spill:
+                placed = !spilled && spill(*producer, msg);
+                break;
+            default:
+                break;
+        }
+
+        if (!placed) {
+            producer->countDropped();
+            msg.releaseSpill();
+        }
+        return placed;
+    }
+
+    /**
+     * @brief attach
+     * @param logger logger to take messages from
+     *
+     * Passes messages of one more logger to this backend. Logger must outlive backend, its queued
+     * messages are rendered with it until backend is stopped.
+     */
+    void attach(TLogger &logger) {
+        std::lock_guard<std::mutex> lock(attached_mutex);
+        if (!worker.joinable()) {
+            return;
+        }
+        logger.setQueueHandler(&AsyncBackend::submitHandler, this, &AsyncBackend::reserveHandler,
+                               &AsyncBackend::commitHandler);
+        attached.push_back(&logger);
+    }
+
+    /**
+     * @brief detach
+     * @param logger attached logger
+     *
+     * Logger renders its messages in caller thread again
+     */
+    void detach(TLogger &logger) {
+        std::lock_guard<std::mutex> lock(attached_mutex);
+        auto it = std::find(attached.begin(), attached.end(), &logger);
+        if (it != attached.end()) {
+            logger.setQueueHandler(nullptr, nullptr);
+            attached.erase(it);
+        }
+    }
+
+    /**
+     * @brief stop
+     *
+     * Detaches backend from all loggers, writes all queued messages and joins background thread
+     */
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(attached_mutex);
+            if (!worker.joinable()) {
+                return;
+            }
+            for (TLogger *logger : attached) {
+                logger->setQueueHandler(nullptr, nullptr);
+            }
+            attached.clear();
+        }
+        running.store(false, std::memory_order_release);
+        worker.join();
+    }
+
+private:
+    /**
+     * @brief The Producer class
+     *
+     * Queue owned by one producer thread. Owner sets `exited` when it ends, background thread
+     * releases the slot once the queue is drained.
+     */
+    struct alignas(LOGGER_CACHE_LINE_SIZE) Producer {
+        std::atomic<bool> claimed = false;
+        /// set after `owner` is written, background thread reads only active queues
+        std::atomic<bool> active = false;
+        /// owner thread ended, it enqueues no more messages
+        std::atomic<bool> exited = false;
+        std::thread::id owner;
+        /// number of dropped messages, written by owner thread only
+        std::atomic<size_t> dropped = 0;
+        /// overflow queue position after the last spilled message, 0 if none waits there.
+        /// Owner thread only
+        size_t spill_end = 0;
+        /// sequence number of the next message, owner thread only
+        uint32_t sequence = 0;
+        TQueue queue;
+
+        void countDropped() {
+            dropped.store(dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+    };
+
+    static bool submitHandler(void *context, const TMessage &msg) {
+        return static_cast<AsyncBackend *>(context)->submit(msg);
+    }
+
+    /**
+     * @brief reserveHandler
+     * @return free slot in queue of calling thread, logger formats message there. nullptr if
+     * queue is full, message goes through `submit` and queue policy then
+     */
+    static TMessage *reserveHandler(void *context) {
+        auto *backend = static_cast<AsyncBackend *>(context);
+        Producer *producer = backend->localProducer();
+        if (producer == nullptr || backend->spilling(*producer)) {
+            return nullptr;
+        }
+        return producer->queue.claim();
+    }
+
+    static void commitHandler(void *context) {
+        auto *backend = static_cast<AsyncBackend *>(context);
+        Producer *producer = backend->localProducer();
+        backend->stamp(*producer, *producer->queue.claim());
+        producer->queue.publish();
+    }
+
+    /// true if `LOGGER_QUEUE_POLICY` of any level spills to overflow queue
+    static constexpr bool spills = [] {
+        for (queuePolicy policy : TConfig::LOGGER_QUEUE_POLICY) {
+            if (policy == queuePolicy::Spill) {
+                return true;
+            }
+        }
+        return false;
+    }();
+
+    /// numbers message in order of its producer thread, only needed to merge overflow queue
+    void stamp(Producer &producer, TMessage &msg) const {
+        if constexpr (spills) {
+            msg.producer = static_cast<uint32_t>(&producer - producers.data());
+            msg.sequence = producer.sequence++;
+        }
+    }
+
+    /// places message in queue of producer thread
+    bool push(Producer &producer, const TMessage &msg) {
+        TMessage *slot = producer.queue.claim();
+        if (slot == nullptr) {
+            return false;
+        }
+        *slot = msg;
+        stamp(producer, *slot);
+        producer.queue.publish();
+        return true;
+    }
+
+    /// places message in overflow queue
+    bool spill(Producer &producer, const TMessage &msg) {
+        TMessage stamped = msg;
+        stamp(producer, stamped);
+        if (!overflow.enqueue(stamped)) {
+            return false;
+        }
+        producer.spill_end = overflow.published();
+        return true;
+    }
+
+    /// true if earlier message of producer thread may still wait in overflow queue
+    bool spilling(Producer &producer) {
+        if constexpr (spills) {
+            if (producer.spill_end == 0) {
+                return false;
+            }
+            if (overflow.position() >= producer.spill_end) {
+                producer.spill_end = 0;
+                return false;
+            }
+            return true;
+        }
+        return false;
+    }
+
+    /// repeats `place` until it succeeds or `LOGGER_QUEUE_TIMEOUT_MS` passes, yields in between
+    template <typename TFunc>
+    static bool retry(const TFunc &place) {
+        constexpr unsigned long timeout_ms = TConfig::LOGGER_QUEUE_TIMEOUT_MS;
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        while (!place()) {
+            if (timeout_ms != 0 && std::chrono::steady_clock::now() >= deadline) {
+                return false;
+            }
+            std::this_thread::yield();
+        }
+        return true;
+    }
+
+    /// number of backends per thread whose queues are released when thread ends
+    static constexpr size_t max_thread_backends = 4;
+
+    /**
+     * @brief The ThreadState class
+     *
+     * Queues registered by one thread, marked as exited when thread ends. Queue of more than
+     * `max_thread_backends` backends is not tracked and stays taken.
+     */
+    struct ThreadState {
+        struct Registration {
+            uint64_t backend_id;
+            Producer *producer;
+        };
+
+        /// last used backend
+        Registration cache = {0, nullptr};
+        std::array<Registration, max_thread_backends> registered = {};
+        size_t registered_count = 0;
+
+        ~ThreadState() {
+            std::lock_guard<std::mutex> lock(liveMutex());
+            for (size_t i = 0; i < registered_count; ++i) {
+                for (AsyncBackend *backend : liveBackends()) {
+                    if (backend->backend_id == registered[i].backend_id) {
+                        registered[i].producer->exited.store(true, std::memory_order_release);
+                    }
+                }
+            }
+            registered_count = 0;
+            cache = {0, nullptr};
+        }
+    };
+
+    /**
+     * @brief localProducer
+     * @return queue of calling thread or nullptr if all `LOGGER_MAX_PRODUCERS` queues are taken
+     *
+     * Last used backend and its queue are cached in thread local storage, so lookup is only done
+     * when thread switches between backends.
+     */
+    Producer *localProducer() {
+        static thread_local ThreadState state;
+
+        if (state.cache.backend_id == backend_id) {
+            return state.cache.producer;
+        }
+
+        bool created = false;
+        Producer *producer = registerProducer(created);
+        if (producer != nullptr) {
+            state.cache = {backend_id, producer};
+            if (created && state.registered_count < state.registered.size()) {
+                state.registered[state.registered_count++] = state.cache;
+            }
+        }
+        return producer;
+    }
+
+    /**
+     * @brief registerProducer
+     * @param created set to true if a free queue was taken
+     * @return queue of calling thread or nullptr if there is no free queue
+     */
+    Producer *registerProducer(bool &created) {
+        const std::thread::id self = std::this_thread::get_id();
+
+        for (auto &producer : producers) {
+            if (producer.active.load(std::memory_order_acquire) &&
+                !producer.exited.load(std::memory_order_acquire) && producer.owner == self) {
+                return &producer;
+            }
+        }
+
+        for (auto &producer : producers) {
+            bool expected = false;
+            if (producer.claimed.compare_exchange_strong(expected, true,
+                                                         std::memory_order_acq_rel)) {
+                producer.owner = self;
+                producer.active.store(true, std::memory_order_release);
+                created = true;
+                return &producer;
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * @brief The Arrivals class
+     *
+     * Times when background thread first saw messages of one queue. Every sweep records published
+     * position of queue, message arrived at the first recorded sweep that covers it. When marks
+     * run out the newest one is moved forward, messages then look younger than they are.
+     */
+    struct Arrivals {
+        struct Mark {
+            size_t published;
+            std::chrono::steady_clock::time_point time;
+        };
+
+        std::array<Mark, 32> marks = {};
+        size_t first = 0;
+        size_t count = 0;
+
+        void note(size_t published, std::chrono::steady_clock::time_point now) {
+            if (count != 0 && marks[(first + count - 1) % marks.size()].published == published) {
+                return;
+            }
+            if (count == marks.size()) {
+                marks[(first + count - 1) % marks.size()] = {published, now};
+                return;
+            }
+            marks[(first + count) % marks.size()] = {published, now};
+            ++count;
+        }
+
+        /// time when message at `position` was seen, `now` if it was not seen yet
+        std::chrono::steady_clock::time_point of(size_t position,
+                                                 std::chrono::steady_clock::time_point now) {
+            while (count != 0 && marks[first].published <= position) {
+                first = (first + 1) % marks.size();
+                --count;
+            }
+            return count != 0 ? marks[first].time : now;
+        }
+
+        void clear() { count = 0; }
+    };
+
+    /**
+     * @brief run
+     *
+     * Background thread loop. Keeps one message from every queue in `heads` and renders the one
+     * with the smallest timestamp when it is safe to do so: every live producer has pending
+     * message or the message arrived at least `LOGGER_REORDER_WINDOW_US` ago. Overflow queue is
+     * merged the same way under the last index, but it is not waited for.
+     */
+    void run() {
+        constexpr size_t max_producers = TConfig::LOGGER_MAX_PRODUCERS;
+        constexpr size_t overflow_idx = max_producers;
+        constexpr auto window = std::chrono::microseconds(TConfig::LOGGER_REORDER_WINDOW_US);
+        constexpr auto poll = std::chrono::microseconds(TConfig::LOGGER_BACKEND_POLL_US);
+
+        std::array<TMessage, max_producers + 1> heads;
+        std::array<std::chrono::steady_clock::time_point, max_producers + 1> arrived;
+        std::array<bool, max_producers + 1> pending = {};
+        std::array<size_t, max_producers + 1> heap = {};
+        size_t heap_size = 0;
+        std::array<Arrivals, max_producers> arrivals;
+
+        /// drop counters already reported in output
+        std::array<size_t, max_producers> reported = {};
+        size_t orphan_reported = 0;
+        long last_timestamp = 0;
+
+        // messages of one thread have growing timestamps, sequence orders those taken at once
+        auto later = [&heads](size_t a, size_t b) {
+            return std::tie(heads[a].timestamp, heads[a].producer, heads[a].sequence) >
+                   std::tie(heads[b].timestamp, heads[b].producer, heads[b].sequence);
+        };
+
+        auto pull = [&](size_t i, auto &queue, std::chrono::steady_clock::time_point seen) {
+            if (pending[i] || !queue.dequeue(heads[i])) {
+                return false;
+            }
+            pending[i] = true;
+            arrived[i] = seen;
+            heap[heap_size++] = i;
+            std::push_heap(heap.begin(), heap.begin() + heap_size, later);
+            return true;
+        };
+
+        std::chrono::steady_clock::time_point now;
+
+        // earlier messages of thread that spilled overflow head may be published after sweep,
+        // they have to be compared with it before it is written
+        auto pullSpiller = [&]() {
+            if constexpr (spills) {
+                const size_t from = heads[heap[0]].producer;
+                return heap[0] == overflow_idx && !pending[from] &&
+                       producers[from].active.load(std::memory_order_acquire) &&
+                       pull(from, producers[from].queue, arrived[overflow_idx]);
+            }
+            return false;
+        };
+
+        while (true) {
+            const bool stopping = !running.load(std::memory_order_acquire);
+            now = std::chrono::steady_clock::now();
+            /// live producers without pending message
+            size_t idle = 0;
+            size_t dropped = 0;
+
+            for (size_t i = 0; i < max_producers; ++i) {
+                Producer &producer = producers[i];
+                if (!producer.active.load(std::memory_order_acquire)) {
+                    continue;
+                }
+                const bool exited = producer.exited.load(std::memory_order_acquire);
+                arrivals[i].note(producer.queue.published(), now);
+                if (!pending[i]) {
+                    pull(i, producer.queue, arrivals[i].of(producer.queue.position(), now));
+                }
+                size_t total = producer.dropped.load(std::memory_order_relaxed);
+                dropped += total - reported[i];
+                reported[i] = total;
+
+                if (pending[i]) {
+                    continue;
+                }
+                if (!exited) {
+                    ++idle;
+                } else if (producer.queue.empty()) {
+                    release(producer);
+                    reported[i] = 0;
+                    arrivals[i].clear();
+                }
+            }
+            pull(overflow_idx, overflow, now);
+
+            size_t orphan_total = orphan_dropped.load(std::memory_order_relaxed);
+            dropped += orphan_total - orphan_reported;
+            orphan_reported = orphan_total;
+
+            if (dropped != 0) {
+                reportDropped(dropped, heap_size != 0 ? heads[heap[0]].timestamp : last_timestamp);
+            }
+
+            if (heap_size == 0) {
+                if (stopping) {
+                    break;
+                }
+                std::this_thread::sleep_for(poll);
+                continue;
+            }
+
+            if (pullSpiller()) {
+                continue;
+            }
+            const size_t top = heap[0];
+            const auto waited = now - arrived[top];
+            if (idle != 0 && !stopping && waited < window) {
+                auto remaining =
+                    std::chrono::duration_cast<std::chrono::microseconds>(window - waited);
+                std::this_thread::sleep_for(std::min(poll, remaining));
+                continue;
+            }
+
+            // write every head that is old enough, written queue is refilled to keep merge order
+            do {
+                const size_t next = heap[0];
+                std::pop_heap(heap.begin(), heap.begin() + heap_size, later);
+                --heap_size;
+                pending[next] = false;
+                last_timestamp = heads[next].timestamp;
+                renderer(heads[next]).log(heads[next]);
+                if (next == overflow_idx) {
+                    pull(overflow_idx, overflow, now);
+                } else {
+                    TQueue &queue = producers[next].queue;
+                    pull(next, queue, arrivals[next].of(queue.position(), now));
+                }
+            } while (heap_size != 0 && (stopping || now - arrived[heap[0]] >= window) &&
+                     !pullSpiller());
+        }
+    }
+
+    /**
+     * @brief release
+     * @param producer drained queue of exited thread
+     *
+     * Makes queue free for a new producer thread
+     */
+    static void release(Producer &producer) {
+        producer.dropped.store(0, std::memory_order_relaxed);
+        producer.exited.store(false, std::memory_order_relaxed);
+        producer.active.store(false, std::memory_order_relaxed);
+        producer.claimed.store(false, std::memory_order_release);
+    }
+
+    /**
+     * @brief reportDropped
+     * @param count number of messages dropped since last report
+     * @param timestamp time to place report at
+     *
+     * Writes synthetic "N messages dropped" line
+     */
+    void reportDropped(size_t count, long timestamp) const {
+        TMessage msg;
+        msg.record = LogRecord(level::WarningMsg, LOG_SOURCE_LOCATION);
+        msg.timestamp = timestamp;
+        auto res = fmt::format_to_n(msg.user_data.data(), msg.user_data.size(),
+                                    "{:d} messages dropped\n", count);
+        msg.user_data_len = std::min(res.size, msg.user_data.size());
+        logger_instance.log(msg);
+    }
+
+    /// logger that captured message, only attached loggers queue messages here
+    const TLogger &renderer(const TMessage &msg) const {
+        return msg.source != nullptr ? *static_cast<const TLogger *>(msg.source) : logger_instance;
+    }
+
+    /// backends alive in process, thread exit marks queues only of these
+    static std::mutex &liveMutex() {
+        static std::mutex mutex;
+        return mutex;
+    }
+
+    static std::vector<AsyncBackend *> &liveBackends() {
+        static std::vector<AsyncBackend *> backends;
+        return backends;
+    }
+
+    static uint64_t nextBackendId() {
+        static std::atomic<uint64_t> counter = 0;
+        return ++counter;
+    }
+
+    /// logger that reports dropped messages and renders messages without `source`
+    TLogger &logger_instance;
+    /// loggers that queue messages here, @see attach
+    std::vector<TLogger *> attached;
+    std::mutex attached_mutex;
+    /// unique id used to validate thread local queue cache
+    const uint64_t backend_id = nextBackendId();
+    /// queues of producer threads
+    std::array<Producer, TConfig::LOGGER_MAX_PRODUCERS> producers;
+    /// messages spilled from full producer queues
+    TOverflowQueue overflow;
+    /// messages dropped because there was no free producer queue
+    std::atomic<size_t> orphan_dropped = 0;
+    std::atomic<bool> running = true;
+    std::thread worker;
+};
+
+}  // namespace Log
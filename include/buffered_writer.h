@@ -0,0 +1,270 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "log_index.h"
+#include "logger_config.h"
+
+namespace Log {
+
+/**
+ * @brief The BufferedWriter class
+ *
+ * Buffers of file sinks that render messages in place and write them from background thread.
+ * Logging thread renders message in active buffer between `reserve` and `commit`. Buffer is
+ * sealed and passed to background thread when the next message does not fit, partially filled
+ * one after `flush_interval_ms`. If all buffers are being written, logging thread waits.
+ *
+ * Derived class owns the output and implements:
+ *  - `void commitImpl(Buffer &buf, level msgType, long timestamp, size_t size)` accounts
+ *    message placed at `buf.len`, mutex is locked;
+ *  - `void writeImpl(const std::vector<size_t> &ready, std::vector<size_t> &done)` writes
+ *    sealed buffers `ready` in order and places buffers that are written or failed in `done`;
+ *  - `bool idleImpl() const` returns false while buffers passed to `writeImpl` are in progress.
+ *
+ * Derived constructor calls `start` when output is ready, its destructor calls `stop` first.
+ * All memory is allocated by constructor, `reserve` and `commit` never allocate: derived class
+ * reserves index entries of buffers with `reserveEntries`.
+ */
+template <typename Derived>
+class BufferedWriter {
+public:
+    struct Buffer {
+        char *data = nullptr;
+        size_t len = 0;
+        /// index entries of messages in buffer
+        std::vector<Index::Entry> entries;
+    };
+
+    BufferedWriter(const BufferedWriter &) = delete;
+    BufferedWriter &operator=(const BufferedWriter &) = delete;
+
+    /**
+     * @brief reserve
+     * @return place for up to `size` bytes, mutex stays locked until `commit`. nullptr if
+     * message is longer than buffer or buffers could not be allocated
+     *
+     * Logger asks for the longest message it renders, so when the rest of active buffer is
+     * shorter, message is rendered in spare buffer of `capacity` bytes and `commit` places it by
+     * its real size. Next buffer is taken before that, so `commit` never waits
+     */
+    char *reserve(size_t size) {
+        if (size > capacity || buffers.empty()) {
+            return nullptr;
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            if (active == none && !free_buffers.empty()) {
+                activate();
+            }
+            if (active != none) {
+                Buffer &buf = buffers[active];
+                if (buf.len + size <= capacity) {
+                    lock.release();
+                    return buf.data + buf.len;
+                }
+                if (!free_buffers.empty()) {
+                    lock.release();
+                    return spare.data();
+                }
+            }
+            buffer_free.wait(lock);
+        }
+    }
+
+    /**
+     * @brief commit
+     * @param data place returned by `reserve`
+     * @param size length of message written there
+     */
+    void commit(level msgType, long timestamp, const char *data, size_t size) {
+        std::lock_guard<std::mutex> lock(mutex, std::adopt_lock);
+        if (data == spare.data()) {
+            if (buffers[active].len + size > capacity) {
+                seal();
+                activate();
+            }
+            std::memcpy(buffers[active].data + buffers[active].len, data, size);
+        }
+        Buffer &buf = buffers[active];
+        static_cast<Derived *>(this)->commitImpl(buf, msgType, timestamp, size);
+        buf.len += size;
+    }
+
+    /**
+     * @brief flush
+     *
+     * Seals partially filled buffer and waits until all buffers are written
+     */
+    void flush() {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (active != none && buffers[active].len != 0) {
+            seal();
+        }
+        buffer_free.wait(lock, [this] {
+            return sealed.empty() && free_buffers.size() + (active != none) == buffers.size();
+        });
+    }
+
+    /**
+     * @brief failedWrites
+     * @return number of buffers that did not reach output whole
+     */
+    size_t failedWrites() const { return failed.load(std::memory_order_relaxed); }
+
+protected:
+    /**
+     * @brief BufferedWriter
+     * @param buffer_size capacity of buffer, also the longest message
+     * @param count number of buffers, at least 2
+     * @param alignment alignment of buffer memory
+     * @param flush_interval_ms time after which partially filled buffer is sealed
+     */
+    BufferedWriter(size_t buffer_size,
+                   size_t count,
+                   size_t alignment,
+                   unsigned long flush_interval_ms)
+        : capacity(buffer_size),
+          buffers(count < 2 ? 2 : count),
+          flush_interval(flush_interval_ms) {
+        const size_t alloc_size = (capacity + alignment - 1) / alignment * alignment;
+        for (size_t i = 0; i < buffers.size(); ++i) {
+            buffers[i].data = static_cast<char *>(std::aligned_alloc(alignment, alloc_size));
+            if (buffers[i].data == nullptr) {
+                // writer without buffers discards messages
+                release();
+                return;
+            }
+            free_buffers.push_back(i);
+        }
+        spare.resize(capacity);
+        sealed.reserve(buffers.size());
+    }
+
+    ~BufferedWriter() { release(); }
+
+    /// starts background thread
+    void start() { worker = std::thread(&BufferedWriter::run, this); }
+
+    /// writes remaining buffers and stops background thread
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running = false;
+        }
+        work_ready.notify_one();
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+
+    /// counts buffer that did not reach output whole
+    void failedWrite() { failed.fetch_add(1, std::memory_order_relaxed); }
+
+    /// reserves `count` index entries in every buffer, so `commitImpl` does not allocate
+    void reserveEntries(size_t count) {
+        for (Buffer &buf : buffers) {
+            buf.entries.reserve(count);
+        }
+    }
+
+    const size_t capacity;
+    /// buffer is used by background thread only from `writeImpl` until it is in `done`
+    std::vector<Buffer> buffers;
+
+private:
+    static constexpr size_t none = static_cast<size_t>(-1);
+
+    void release() {
+        for (Buffer &buf : buffers) {
+            std::free(buf.data);
+        }
+        buffers.clear();
+        free_buffers.clear();
+    }
+
+    /// makes free buffer active, mutex must be locked
+    void activate() {
+        active = free_buffers.back();
+        free_buffers.pop_back();
+        buffers[active].len = 0;
+        buffers[active].entries.clear();
+    }
+
+    /// passes active buffer to background thread, mutex must be locked
+    void seal() {
+        sealed.push_back(active);
+        active = none;
+        work_ready.notify_one();
+    }
+
+    void run() {
+        auto *derived = static_cast<Derived *>(this);
+        auto has_work = [this] { return !sealed.empty() || !running; };
+        // `ready` is swapped with `sealed`, that is filled by logging threads
+        std::vector<size_t> ready;
+        ready.reserve(buffers.size());
+        std::vector<size_t> done;
+        done.reserve(buffers.size());
+        std::unique_lock<std::mutex> lock(mutex);
+
+        while (true) {
+            if (sealed.empty() && derived->idleImpl()) {
+                if (!running) {
+                    if (active == none || buffers[active].len == 0) {
+                        break;
+                    }
+                    seal();
+                } else if (!work_ready.wait_for(lock, flush_interval, has_work)) {
+                    // interval passed without full buffer
+                    if (active != none && buffers[active].len != 0) {
+                        seal();
+                    }
+                }
+                continue;
+            }
+
+            ready.swap(sealed);
+            lock.unlock();
+            derived->writeImpl(ready, done);
+            ready.clear();
+            lock.lock();
+
+            for (size_t idx : done) {
+                free_buffers.push_back(idx);
+            }
+            if (!done.empty()) {
+                buffer_free.notify_all();
+            }
+            done.clear();
+        }
+    }
+
+    const std::chrono::milliseconds flush_interval;
+
+    std::mutex mutex;
+    /// signals background thread that buffer is sealed or writer stops
+    std::condition_variable work_ready;
+    /// signals logging threads that buffer is free
+    std::condition_variable buffer_free;
+    /// buffers ready to be filled
+    std::vector<size_t> free_buffers;
+    /// full buffers in order they are written
+    std::vector<size_t> sealed;
+    /// buffer being filled, `none` if there is no one
+    size_t active = none;
+    /// message that may not fit in the rest of active buffer
+    std::vector<char> spare;
+    bool running = true;
+    std::atomic<size_t> failed = 0;
+    std::thread worker;
+};
+
+}  // namespace Log
@@ -0,0 +1,212 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "buffered_writer.h"
+#include "logger.h"
+#include "log_frame.h"
+#include "log_index.h"
+
+namespace Log {
+
+/**
+ * @brief The CompressedFileSink class
+ *
+ * Writes messages to file compressed in independent blocks, @see log_frame.h. Messages are
+ * collected in block buffer, full block is compressed and written by background thread, so
+ * logging thread only copies message. If all buffers wait for compression, logging thread waits
+ * too. Partially filled block is written after `flush_interval_ms`. Block is sealed only when the
+ * next message does not fit, the last messages of block are rendered in one more spare buffer
+ * and copied there.
+ *
+ * When file would grow over `max_file_size` it is renamed to "<path>.1", older files are shifted
+ * up to "<path>.<max_files - 1>", the oldest one is removed. Existing file is rotated the same
+ * way on start, so every file is written by one process. Use `cpplog-cat` tool to read files.
+ *
+ * With `write_index` every file gets sparse index "<file>.idx" with time range and levels of
+ * each block, @see log_index.h. Index is rotated with its file, `cpplog-query` uses it.
+ *
+ * Sink is a handle, copies share the same file. File is flushed and closed when the last copy
+ * is destroyed.
+ */
+class CompressedFileSink : public ILogSink<CompressedFileSink> {
+public:
+    struct Options {
+        /// size of uncompressed block, also the longest message
+        size_t block_size = 64 * 1024;
+        /// number of block buffers
+        size_t buffers = 4;
+        /// size of file that triggers rotation
+        size_t max_file_size = 64 * 1024 * 1024;
+        /// number of files including current one
+        size_t max_files = 5;
+        /// time after which partially filled block is written
+        unsigned long flush_interval_ms = 1000;
+        /// write index entry for every block
+        bool write_index = false;
+    };
+
+    /// messages are rendered directly in block buffer
+    static constexpr bool supportsReserve = true;
+    /// timestamps go to index
+    static constexpr bool usesTimestamp = true;
+
+    explicit CompressedFileSink(const std::string &path)
+        : CompressedFileSink(path, Options()) {}
+
+    CompressedFileSink(const std::string &path, const Options &options)
+        : writer(std::make_shared<Writer>(path, options)) {}
+
+    void sendImpl(const level msgType, long timestamp, const char *data, size_t size) const {
+        char *buf = writer->reserve(size);
+        if (buf != nullptr) {
+            std::memcpy(buf, data, size);
+            writer->commit(msgType, timestamp, buf, size);
+        }
+    }
+
+    char *reserveImpl(size_t size) const { return writer->reserve(size); }
+
+    void commitImpl(const level msgType, long timestamp, char *data, size_t size) const {
+        writer->commit(msgType, timestamp, data, size);
+    }
+
+    /**
+     * @brief flush
+     *
+     * Writes partially filled block and waits until all blocks are in file
+     */
+    void flush() const { writer->flush(); }
+
+    /**
+     * @brief failedWrites
+     * @return number of blocks that could not be written, their messages are lost
+     */
+    size_t failedWrites() const { return writer->failedWrites(); }
+
+private:
+    class Writer : public BufferedWriter<Writer> {
+    public:
+        Writer(const std::string &file_path, const Options &opts)
+            : BufferedWriter(opts.block_size,
+                             opts.buffers,
+                             alignof(std::max_align_t),
+                             opts.flush_interval_ms),
+              path(file_path),
+              options(opts),
+              compressed(Frame::BLOCK_HEADER_SIZE + Lz::compressBound(opts.block_size)) {
+            reserveEntries(1);
+            openFile();
+            start();
+        }
+
+        ~Writer() {
+            stop();
+            if (file != nullptr) {
+                std::fclose(file);
+            }
+        }
+
+        void commitImpl(Buffer &buf, level msgType, long timestamp, [[maybe_unused]] size_t size) {
+            // the whole buffer is one block with one index entry
+            if (buf.entries.empty()) {
+                buf.entries.emplace_back();
+            }
+            buf.entries.back().add(msgType, timestamp);
+        }
+
+        void writeImpl(const std::vector<size_t> &ready, std::vector<size_t> &done) {
+            for (size_t idx : ready) {
+                writeBlock(buffers[idx]);
+                done.push_back(idx);
+            }
+        }
+
+        bool idleImpl() const { return true; }
+
+    private:
+        void writeBlock(const Buffer &buf) {
+            size_t size = Frame::encodeBlock(buf.data, buf.len, compressed.data());
+            if (file != nullptr && file_size > Frame::FILE_HEADER_SIZE &&
+                file_size + size > options.max_file_size) {
+                std::fclose(file);
+                file = nullptr;
+                openFile();
+            }
+            // block goes to the kernel whole, crash never leaves it half written in our buffer
+            if (file == nullptr || std::fwrite(compressed.data(), 1, size, file) != size) {
+                failedWrite();
+                return;
+            }
+            std::fflush(file);
+            if (options.write_index && !buf.entries.empty()) {
+                Index::Entry entry = buf.entries.front();
+                entry.offset = file_size;
+                entry.size = static_cast<uint32_t>(size);
+                index.add(entry);
+                index.flush();
+            }
+            file_size += size;
+        }
+
+        std::string rotatedName(size_t idx) const { return path + "." + std::to_string(idx); }
+
+        /// shifts "<path>.N<suffix>" files by one
+        void rotate(const std::string &suffix) const {
+            std::remove((rotatedName(options.max_files - 1) + suffix).c_str());
+            for (size_t i = options.max_files - 1; i > 1; --i) {
+                std::rename((rotatedName(i - 1) + suffix).c_str(),
+                            (rotatedName(i) + suffix).c_str());
+            }
+            std::rename((path + suffix).c_str(), (rotatedName(1) + suffix).c_str());
+        }
+
+        /// rotates existing files and starts new one
+        void openFile() {
+            if (std::FILE *existing = std::fopen(path.c_str(), "rb")) {
+                std::fclose(existing);
+                if (options.max_files > 1) {
+                    rotate("");
+                    // index is moved even if file was written without it, so it never
+                    // describes other file
+                    rotate(Index::indexPath(""));
+                }
+            }
+
+            if (options.write_index) {
+                index.open(Index::indexPath(path), Index::dataFormat::Compressed, false);
+            } else {
+                std::remove(Index::indexPath(path).c_str());
+            }
+            file = std::fopen(path.c_str(), "wb");
+            file_size = 0;
+            if (file == nullptr) {
+                return;
+            }
+            char header[Frame::FILE_HEADER_SIZE];
+            Frame::fileHeader(header);
+            if (std::fwrite(header, 1, sizeof(header), file) == sizeof(header)) {
+                std::fflush(file);
+                file_size = sizeof(header);
+            }
+        }
+
+        const std::string path;
+        const Options options;
+
+        /// used by background thread only
+        std::vector<char> compressed;
+        std::FILE *file = nullptr;
+        size_t file_size = 0;
+        Index::Writer index;
+    };
+
+    std::shared_ptr<Writer> writer;
+};
+
+}  // namespace Log
@@ -1,6 +1,7 @@
 
 #pragma once
 
+#include <chrono>
 #include <cstddef>
 
 #include "message.h"
@@ -22,6 +23,10 @@ public:
 
     bool enqueue(const MessageType &msg) { return static_cast<Derived *>(this)->enqueueImpl(msg); }
 
+    bool enqueueBlocking(const MessageType &msg, unsigned long timeout_ms = 0) {
+        return static_cast<Derived *>(this)->enqueueBlockingImpl(msg, timeout_ms);
+    }
+
     bool dequeue(MessageType &msg) { return static_cast<Derived *>(this)->dequeueImpl(msg); }
 
     bool dequeueBlocking(MessageType &msg, unsigned long timeout_ms = 0) {
@@ -51,6 +56,23 @@ public:
     long long getTimestamp() const {
         return static_cast<const Derived *>(this)->getTimestampImpl();
     }
+
+    /**
+     * @brief getSpanTime
+     * @return monotonic time in nanoseconds used by `LOG_SCOPE`
+     *
+     * Provider may define `getSpanTimeImpl` with cheaper clock (cycle counter, hardware timer),
+     * `std::chrono::steady_clock` is used otherwise.
+     */
+    long long getSpanTime() const {
+        return static_cast<const Derived *>(this)->getSpanTimeImpl();
+    }
+
+    long long getSpanTimeImpl() const {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
 };
 
 }  // namespace Log
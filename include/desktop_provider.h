@@ -18,13 +18,19 @@
     #include <psapi.h>
 
     #define localtime_r(T, Tm) (localtime_s(Tm, T) ? nullptr : Tm)
+    #define tzset _tzset
 #endif
 
 #include "default_provider.h"
 
 class DesktopContext : public Log::IContextProvider<DesktopContext> {
 public:
-    DesktopContext() { getCurrentProcessName(); }
+    DesktopContext() {
+        // time zone is loaded here, the first local time conversion of logging call would read
+        // and allocate it
+        tzset();
+        getCurrentProcessName();
+    }
 
     long long getTimestampImpl() const {
         time_t timestamp = 0;
@@ -120,6 +126,7 @@ private:
 
 #if defined(_WIN32)
     #undef localtime_r
+    #undef tzset
 #endif
 
 #endif
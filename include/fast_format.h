@@ -0,0 +1,395 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include "fmt/base.h"
+#include "hex_dump.h"
+#include "message.h"
+
+namespace Log {
+namespace Fast {
+
+/**
+ * Formatting of the most common logging arguments without fmt argument machinery. Handles
+ * format strings with plain "{}" fields and "{:x}", "{:X}", "{:#x}", "{:#X}" for integers, and
+ * arguments of integer, bool, char, floating point, string, void pointer and `HexDump` types.
+ * Output is the same as fmt gives for these fields. Anything else is reported as unsupported and
+ * caller formats with fmt.
+ */
+
+/// returned by `formatTo` if format string needs fmt
+static constexpr size_t unsupported = static_cast<size_t>(-1);
+/// longest formatted number: 20 digits and sign, or double "-d.dddddddddddddddde-308"
+static constexpr size_t max_number_size = 32;
+
+/// "00" to "99", two digits are placed with one copy
+static constexpr char digit_pairs[] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+inline unsigned countDigits(uint64_t value) {
+    unsigned count = 1;
+    while (true) {
+        if (value < 10) {
+            return count;
+        }
+        if (value < 100) {
+            return count + 1;
+        }
+        if (value < 1000) {
+            return count + 2;
+        }
+        if (value < 10000) {
+            return count + 3;
+        }
+        value /= 10000;
+        count += 4;
+    }
+}
+
+/**
+ * @brief formatDecimal
+ * @param out buffer of at least `max_number_size` bytes
+ * @return number of characters written
+ */
+inline size_t formatDecimal(char *out, uint64_t value) {
+    const unsigned len = countDigits(value);
+    char *p = out + len;
+    while (value >= 100) {
+        const auto idx = static_cast<size_t>(value % 100) * 2;
+        value /= 100;
+        p -= 2;
+        std::memcpy(p, digit_pairs + idx, 2);
+    }
+    if (value >= 10) {
+        std::memcpy(p - 2, digit_pairs + value * 2, 2);
+    } else {
+        p[-1] = static_cast<char>('0' + value);
+    }
+    return len;
+}
+
+inline size_t formatDecimal(char *out, int64_t value) {
+    if (value < 0) {
+        *out = '-';
+        return 1 + formatDecimal(out + 1, 0 - static_cast<uint64_t>(value));
+    }
+    return formatDecimal(out, static_cast<uint64_t>(value));
+}
+
+/**
+ * @brief formatHex
+ * @param out buffer of at least `max_number_size` bytes
+ * @param upper use upper case digits
+ * @return number of characters written
+ */
+inline size_t formatHex(char *out, uint64_t value, bool upper) {
+    const char *digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    size_t len = 1;
+    for (uint64_t rest = value >> 4; rest != 0; rest >>= 4) {
+        ++len;
+    }
+    for (size_t i = len; i != 0; --i) {
+        out[i - 1] = digits[value & 0xF];
+        value >>= 4;
+    }
+    return len;
+}
+
+/**
+ * @brief formatFloat
+ * @param out buffer of at least `max_number_size` bytes
+ * @return number of characters written
+ *
+ * Shortest representation that reads back to the same value. Written by fmt through `base.h`
+ * API, so fmt float writer stays in compiled fmt library and header footprint is not grown.
+ */
+template <typename T>
+size_t formatFloat(char *out, T value) {
+    return fmt::format_to_n(out, max_number_size, "{}", value).size;
+}
+
+/**
+ * @brief The Arg struct
+ *
+ * Argument with type known to fast formatter
+ */
+struct Arg {
+    enum class kind : unsigned char {
+        Int,
+        Uint,
+        Bool,
+        Char,
+        Double,
+        Float,
+        String,
+        Pointer,
+        Dump,
+        Other,
+    };
+
+    kind type = kind::Other;
+    union {
+        int64_t i;
+        uint64_t u;
+        double d;
+        float f;
+        bool b;
+        char c;
+        const void *p;
+        std::string_view s;
+        const HexDump *dump;
+    };
+
+    Arg()
+        : i(0) {}
+};
+
+template <typename T>
+constexpr bool isSupported() {
+    // fmt prints `signed char` and `unsigned char` as numbers, `char` as character
+    return std::is_same_v<T, bool> || std::is_same_v<T, char> ||
+           std::is_same_v<T, signed char> || std::is_same_v<T, unsigned char> ||
+           std::is_same_v<T, short> || std::is_same_v<T, unsigned short> ||
+           std::is_same_v<T, int> || std::is_same_v<T, unsigned> || std::is_same_v<T, long> ||
+           std::is_same_v<T, unsigned long> || std::is_same_v<T, long long> ||
+           std::is_same_v<T, unsigned long long> || std::is_same_v<T, float> ||
+           std::is_same_v<T, double> || std::is_same_v<T, const char *> ||
+           std::is_same_v<T, char *> || std::is_same_v<T, std::string_view> ||
+           std::is_same_v<T, std::string> || std::is_same_v<T, const void *> ||
+           std::is_same_v<T, void *> || std::is_same_v<T, std::nullptr_t> ||
+           std::is_same_v<T, HexDump> || std::is_same_v<T, Field>;
+}
+
+/// true if fast formatter takes all arguments, checked before format string is looked at
+template <typename... Args>
+constexpr bool supported = (isSupported<std::decay_t<Args>>() && ...);
+
+template <typename T>
+Arg makeArg(const T &value) {
+    // string literals come as arrays
+    using Type = std::decay_t<const T>;
+    Arg arg;
+    if constexpr (std::is_same_v<Type, bool>) {
+        arg.type = Arg::kind::Bool;
+        arg.b = value;
+    } else if constexpr (std::is_same_v<Type, char>) {
+        arg.type = Arg::kind::Char;
+        arg.c = value;
+    } else if constexpr (std::is_integral_v<Type> && std::is_signed_v<Type>) {
+        arg.type = Arg::kind::Int;
+        arg.i = value;
+    } else if constexpr (std::is_integral_v<Type>) {
+        arg.type = Arg::kind::Uint;
+        arg.u = value;
+    } else if constexpr (std::is_same_v<Type, double>) {
+        arg.type = Arg::kind::Double;
+        arg.d = value;
+    } else if constexpr (std::is_same_v<Type, float>) {
+        arg.type = Arg::kind::Float;
+        arg.f = value;
+    } else if constexpr (std::is_same_v<Type, const char *> || std::is_same_v<Type, char *>) {
+        // null string is left to fmt, arrays are never null
+        if (std::is_array_v<T> || value != nullptr) {
+            arg.type = Arg::kind::String;
+            arg.s = std::string_view(value);
+        }
+    } else if constexpr (std::is_same_v<Type, std::string_view> ||
+                         std::is_same_v<Type, std::string>) {
+        arg.type = Arg::kind::String;
+        arg.s = std::string_view(value);
+    } else if constexpr (std::is_same_v<Type, std::nullptr_t>) {
+        arg.type = Arg::kind::Pointer;
+        arg.p = nullptr;
+    } else if constexpr (std::is_pointer_v<Type>) {
+        arg.type = Arg::kind::Pointer;
+        arg.p = value;
+    } else if constexpr (std::is_same_v<Type, HexDump>) {
+        arg.type = Arg::kind::Dump;
+        arg.dump = &value;
+    }
+    // `Field` is `kind::Other`, fine while format string does not refer to it
+    return arg;
+}
+
+/**
+ * @brief The Output class
+ *
+ * Places text in buffer up to its end and counts full length as `fmt::format_to_n` does
+ */
+class Output {
+public:
+    Output(char *buffer, size_t bufferSize)
+        : out(buffer),
+          size(bufferSize) {}
+
+    void append(const char *data, size_t len) {
+        if (pos < size) {
+            std::memcpy(out + pos, data, std::min(len, size - pos));
+        }
+        pos += len;
+    }
+
+    /// places number formatted by `kernel`, directly in buffer if there is room
+    template <typename TKernel>
+    void appendNumber(const TKernel &kernel) {
+        if (pos < size && size - pos >= max_number_size) {
+            pos += kernel(out + pos);
+            return;
+        }
+        std::array<char, max_number_size> tmp;
+        append(tmp.data(), kernel(tmp.data()));
+    }
+
+    /// places lines of dump up to the end of buffer
+    void appendDump(const HexDump &dump) {
+        pos += Dump::format(out + std::min(pos, size), pos < size ? size - pos : 0, dump);
+    }
+
+    size_t length() const { return pos; }
+
+private:
+    char *out;
+    size_t size;
+    size_t pos = 0;
+};
+
+/**
+ * @brief formatField
+ * @param spec text between ':' and '}' of replacement field, empty for "{}"
+ * @return false if fmt is needed
+ */
+inline bool formatField(Output &out, const Arg &arg, std::string_view spec) {
+    if (!spec.empty()) {
+        const bool alt = spec.front() == '#';
+        if (alt) {
+            spec.remove_prefix(1);
+        }
+        if ((spec != "x" && spec != "X") ||
+            (arg.type != Arg::kind::Int && arg.type != Arg::kind::Uint)) {
+            return false;
+        }
+        const bool upper = spec == "X";
+        const bool negative = arg.type == Arg::kind::Int && arg.i < 0;
+        const uint64_t value = negative ? 0 - static_cast<uint64_t>(arg.i) : arg.u;
+        out.appendNumber([&](char *buf) {
+            size_t len = 0;
+            if (negative) {
+                buf[len++] = '-';
+            }
+            if (alt) {
+                buf[len++] = '0';
+                buf[len++] = upper ? 'X' : 'x';
+            }
+            return len + formatHex(buf + len, value, upper);
+        });
+        return true;
+    }
+
+    switch (arg.type) {
+        case Arg::kind::Int:
+            out.appendNumber([&](char *buf) { return formatDecimal(buf, arg.i); });
+            return true;
+        case Arg::kind::Uint:
+            out.appendNumber([&](char *buf) { return formatDecimal(buf, arg.u); });
+            return true;
+        case Arg::kind::Bool:
+            out.append(arg.b ? "true" : "false", arg.b ? 4 : 5);
+            return true;
+        case Arg::kind::Char:
+            out.append(&arg.c, 1);
+            return true;
+        case Arg::kind::Double:
+            out.appendNumber([&](char *buf) { return formatFloat(buf, arg.d); });
+            return true;
+        case Arg::kind::Float:
+            out.appendNumber([&](char *buf) { return formatFloat(buf, arg.f); });
+            return true;
+        case Arg::kind::String:
+            out.append(arg.s.data(), arg.s.size());
+            return true;
+        case Arg::kind::Dump:
+            out.appendDump(*arg.dump);
+            return true;
+        case Arg::kind::Pointer:
+            out.appendNumber([&](char *buf) {
+                buf[0] = '0';
+                buf[1] = 'x';
+                return 2 + formatHex(buf + 2, reinterpret_cast<uintptr_t>(arg.p), false);
+            });
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * @brief formatTo
+ * @param out output buffer
+ * @param size buffer size
+ * @param fmt format string checked by fmt during compilation
+ * @param args arguments of types accepted by `supported`
+ * @return length of full formatted text (may be larger than `size`), `unsupported` if format
+ * string has fields fast formatter does not handle, buffer content is undefined then
+ */
+template <typename... Args>
+size_t formatTo(char *out, size_t size, std::string_view fmt, const Args &...args) {
+    const std::array<Arg, sizeof...(Args)> arg_list = {makeArg(args)...};
+    Output output(out, size);
+    size_t next_arg = 0;
+
+    const char *p = fmt.data();
+    const char *const end = p + fmt.size();
+    while (p < end) {
+        const char *brace = p;
+        while (brace < end && *brace != '{' && *brace != '}') {
+            ++brace;
+        }
+        output.append(p, static_cast<size_t>(brace - p));
+        if (brace == end) {
+            break;
+        }
+        // "{{" and "}}" are escaped braces
+        if (brace + 1 < end && brace[1] == *brace) {
+            output.append(brace, 1);
+            p = brace + 2;
+            continue;
+        }
+        if (*brace == '}') {
+            return unsupported;
+        }
+
+        const char *close = brace + 1;
+        while (close < end && *close != '}') {
+            ++close;
+        }
+        std::string_view field(brace + 1, static_cast<size_t>(close - brace - 1));
+        // explicit argument index or nested fields are left to fmt
+        if (close == end || next_arg >= arg_list.size() ||
+            (!field.empty() && field.front() != ':')) {
+            return unsupported;
+        }
+        if (!field.empty()) {
+            field.remove_prefix(1);
+        }
+        if (!formatField(output, arg_list[next_arg++], field)) {
+            return unsupported;
+        }
+        p = close + 1;
+    }
+    return output.length();
+}
+
+}  // namespace Fast
+}  // namespace Log
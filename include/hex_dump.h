@@ -0,0 +1,236 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSSE3__) || defined(__AVX2__)
+    #include <immintrin.h>
+    #define LOG_HAS_SSSE3 1
+#endif
+
+#include "fmt/base.h"
+#include "logger_config.h"
+
+namespace Log {
+
+/**
+ * @brief The HexDump struct
+ *
+ * Binary blob argument of logging call, created with `hexdump`. Printed as lines of 16 bytes in
+ * `hexdump -C` layout, every line starts with new line:
+ *
+ *   00000010  48 65 6c 6c 6f 2c 20 77  6f 72 6c 64 21 0a 00 ff  |Hello, world!...|
+ *
+ * Data is read when message is formatted, in caller thread.
+ */
+struct HexDump {
+    const unsigned char *data = nullptr;
+    /// number of bytes printed
+    size_t size = 0;
+    /// size of the whole blob, bytes after `size` are only counted
+    size_t total = 0;
+};
+
+/**
+ * @brief hexdump
+ * @param data blob to print
+ * @param size blob size
+ * @param max_bytes number of bytes printed, the rest is reported as "... N more bytes"
+ * @return argument to pass to logging macros for "{}" field
+ * @example Debug(logger, "rx frame{}", Log::hexdump(frame, len));
+ */
+inline HexDump hexdump(const void *data,
+                       size_t size,
+                       size_t max_bytes = Config::BaseTraits::LOGGER_MAX_DUMP_SIZE) {
+    return HexDump{static_cast<const unsigned char *>(data), std::min(size, max_bytes), size};
+}
+
+namespace Dump {
+
+static constexpr size_t bytes_per_line = 16;
+/// "\n", 8 digits of offset and two spaces
+static constexpr size_t prefix_size = 11;
+/// 16 "hh " groups, extra space after the 8th group and space before ASCII column
+static constexpr size_t hex_column_size = bytes_per_line * 3 + 2;
+/// full line, ASCII column is enclosed in '|'
+static constexpr size_t line_size = prefix_size + hex_column_size + bytes_per_line + 2;
+/// vector stores may pass the end of line
+static constexpr size_t line_buffer_size = line_size + 16;
+/// "\n... ", " more bytes"
+static constexpr size_t note_text_size = 16;
+
+static constexpr char digits[] = "0123456789abcdef";
+
+/**
+ * @brief formatLine
+ * @param out buffer of at least `line_buffer_size` bytes
+ * @param data bytes of line
+ * @param count number of bytes in line, 1 to `bytes_per_line`
+ * @param offset offset of line in blob
+ * @return number of characters written
+ *
+ * Full lines are converted with nibble shuffles when SSSE3 is available.
+ */
+inline size_t formatLine(char *out, const unsigned char *data, size_t count, size_t offset) {
+    out[0] = '\n';
+    for (size_t i = 0; i < 8; ++i) {
+        out[8 - i] = digits[(offset >> (4 * i)) & 0xF];
+    }
+    out[9] = ' ';
+    out[10] = ' ';
+    char *hex = out + prefix_size;
+    char *ascii = hex + hex_column_size + 1;
+
+#if defined(LOG_HAS_SSSE3)
+    if (count == bytes_per_line) {
+        const __m128i table = _mm_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a',
+                                            'b', 'c', 'd', 'e', 'f');
+        const __m128i low4 = _mm_set1_epi8(0x0F);
+        // "hh " groups of 8 bytes from their 16 digits, -1 lanes become spaces
+        const __m128i spread_lo =
+            _mm_setr_epi8(0, 1, -1, 2, 3, -1, 4, 5, -1, 6, 7, -1, 8, 9, -1, 10);
+        const __m128i spread_hi =
+            _mm_setr_epi8(11, -1, 12, 13, -1, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+        const __m128i gaps_lo = _mm_setr_epi8(0, 0, ' ', 0, 0, ' ', 0, 0, ' ', 0, 0, ' ', 0, 0,
+                                              ' ', 0);
+        const __m128i gaps_hi = _mm_setr_epi8(0, ' ', 0, 0, ' ', 0, 0, ' ', ' ', ' ', ' ', ' ',
+                                              ' ', ' ', ' ', ' ');
+
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+        const __m128i high = _mm_shuffle_epi8(table, _mm_and_si128(_mm_srli_epi16(v, 4), low4));
+        const __m128i low = _mm_shuffle_epi8(table, _mm_and_si128(v, low4));
+        const __m128i first = _mm_unpacklo_epi8(high, low);
+        const __m128i second = _mm_unpackhi_epi8(high, low);
+
+        // spaces stored after every half are overwritten by the next store
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(hex),
+                         _mm_or_si128(_mm_shuffle_epi8(first, spread_lo), gaps_lo));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(hex + 16),
+                         _mm_or_si128(_mm_shuffle_epi8(first, spread_hi), gaps_hi));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(hex + 25),
+                         _mm_or_si128(_mm_shuffle_epi8(second, spread_lo), gaps_lo));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(hex + 41),
+                         _mm_or_si128(_mm_shuffle_epi8(second, spread_hi), gaps_hi));
+
+        // printable ASCII is 0x20..0x7E, bytes from 0x80 are negative in signed compare
+        const __m128i printable = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(0x1F)),
+                                                _mm_cmplt_epi8(v, _mm_set1_epi8(0x7F)));
+        hex[hex_column_size] = '|';
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(ascii),
+                         _mm_or_si128(_mm_and_si128(printable, v),
+                                      _mm_andnot_si128(printable, _mm_set1_epi8('.'))));
+        ascii[bytes_per_line] = '|';
+        return line_size;
+    }
+#endif
+
+    std::memset(hex, ' ', hex_column_size);
+    for (size_t i = 0; i < count; ++i) {
+        const unsigned char byte = data[i];
+        char *group = hex + i * 3 + (i >= bytes_per_line / 2 ? 1 : 0);
+        group[0] = digits[byte >> 4];
+        group[1] = digits[byte & 0xF];
+        ascii[i] = byte >= 0x20 && byte < 0x7F ? static_cast<char>(byte) : '.';
+    }
+    hex[hex_column_size] = '|';
+    ascii[count] = '|';
+    return prefix_size + hex_column_size + count + 2;
+}
+
+constexpr size_t countDigits(size_t value) {
+    size_t count = 1;
+    for (; value >= 10; value /= 10) {
+        ++count;
+    }
+    return count;
+}
+
+/**
+ * @brief formattedSize
+ * @return length of formatted dump, with "... N more bytes" line if it is cut
+ */
+constexpr size_t formattedSize(const HexDump &dump) {
+    const size_t lines = (dump.size + bytes_per_line - 1) / bytes_per_line;
+    size_t len = lines * (prefix_size + hex_column_size + 2) + dump.size;
+    if (dump.total > dump.size) {
+        len += note_text_size + countDigits(dump.total - dump.size);
+    }
+    return len;
+}
+
+/**
+ * @brief format
+ * @param out output buffer
+ * @param size buffer size
+ * @param dump blob to format
+ * @return length of full formatted dump, only `size` bytes of it are placed in `out`
+ *
+ * Lines past the end of buffer are not formatted.
+ */
+inline size_t format(char *out, size_t size, const HexDump &dump) {
+    std::array<char, line_buffer_size> line;
+    size_t pos = 0;
+    auto place = [&](const char *text, size_t len) {
+        std::memcpy(out + pos, text, std::min(len, size - pos));
+        pos += len;
+    };
+
+    for (size_t offset = 0; offset < dump.size && pos < size; offset += bytes_per_line) {
+        const size_t count = std::min(bytes_per_line, dump.size - offset);
+        if (size - pos >= line_buffer_size) {
+            pos += formatLine(out + pos, dump.data + offset, count, offset);
+        } else {
+            place(line.data(), formatLine(line.data(), dump.data + offset, count, offset));
+        }
+    }
+    if (dump.total > dump.size && pos < size) {
+        size_t rest = dump.total - dump.size;
+        const size_t len = countDigits(rest);
+        std::memcpy(line.data(), "\n... ", 5);
+        for (size_t i = len; i != 0; --i, rest /= 10) {
+            line[4 + i] = static_cast<char>('0' + rest % 10);
+        }
+        std::memcpy(line.data() + 5 + len, " more bytes", 11);
+        place(line.data(), note_text_size + len);
+    }
+    return formattedSize(dump);
+}
+
+}  // namespace Dump
+}  // namespace Log
+
+/**
+ * @brief Formatter of binary blob
+ *
+ * Used when message is formatted by fmt, output is the same as of `Log::Dump::format`
+ */
+template <>
+struct fmt::formatter<Log::HexDump> {
+    constexpr auto parse(fmt::format_parse_context &ctx) { return ctx.begin(); }
+
+    template <typename FormatContext>
+    auto format(const Log::HexDump &dump, FormatContext &ctx) const {
+        std::array<char, Log::Dump::line_buffer_size> line;
+        auto out = ctx.out();
+        for (size_t offset = 0; offset < dump.size; offset += Log::Dump::bytes_per_line) {
+            const size_t count = std::min(Log::Dump::bytes_per_line, dump.size - offset);
+            const size_t len =
+                Log::Dump::formatLine(line.data(), dump.data + offset, count, offset);
+            for (size_t i = 0; i < len; ++i) {
+                *out++ = line[i];
+            }
+        }
+        if (dump.total > dump.size) {
+            // dump without lines is the note alone
+            const Log::HexDump note{nullptr, 0, dump.total - dump.size};
+            const size_t len = Log::Dump::format(line.data(), line.size(), note);
+            for (size_t i = 0; i < len; ++i) {
+                *out++ = line[i];
+            }
+        }
+        return out;
+    }
+};
@@ -0,0 +1,224 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "lz_block.h"
+
+namespace Log {
+namespace Frame {
+
+/**
+ * On-disk format of compressed log files. File starts with `FILE_HEADER_SIZE` bytes header:
+ * "CPLZ" magic, format version and reserved bytes. It is followed by independent blocks, every
+ * block has `BLOCK_HEADER_SIZE` bytes header and compressed data:
+ *
+ *   u32 magic "CPLB"
+ *   u32 size of uncompressed data
+ *   u32 size of stored data, `STORED_RAW` bit is set if data is not compressed
+ *   u32 checksum of stored data
+ *
+ * All numbers are little endian. Block is written with single write after it is complete, so
+ * file damaged by crash is readable up to the last complete block.
+ */
+
+static constexpr std::array<char, 4> FILE_MAGIC = {'C', 'P', 'L', 'Z'};
+static constexpr std::array<char, 4> BLOCK_MAGIC = {'C', 'P', 'L', 'B'};
+static constexpr uint8_t VERSION = 1;
+static constexpr size_t FILE_HEADER_SIZE = 8;
+static constexpr size_t BLOCK_HEADER_SIZE = 16;
+static constexpr uint32_t STORED_RAW = 0x80000000U;
+/// upper limit of block size accepted by reader
+static constexpr size_t MAX_BLOCK_SIZE = 16 * 1024 * 1024;
+
+inline void write32(char *out, uint32_t value) {
+    for (size_t i = 0; i < 4; ++i) {
+        out[i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+    }
+}
+
+inline uint32_t read32(const char *in) {
+    uint32_t value = 0;
+    for (size_t i = 0; i < 4; ++i) {
+        value |= static_cast<uint32_t>(static_cast<unsigned char>(in[i])) << (8 * i);
+    }
+    return value;
+}
+
+inline uint32_t rotl32(uint32_t value, unsigned bits) {
+    return (value << bits) | (value >> (32 - bits));
+}
+
+/**
+ * @brief checksum
+ * @return xxHash32 of data with zero seed
+ */
+inline uint32_t checksum(const char *data, size_t size) {
+    constexpr uint32_t prime1 = 2654435761U;
+    constexpr uint32_t prime2 = 2246822519U;
+    constexpr uint32_t prime3 = 3266489917U;
+    constexpr uint32_t prime4 = 668265263U;
+    constexpr uint32_t prime5 = 374761393U;
+
+    const auto *in = reinterpret_cast<const unsigned char *>(data);
+    const unsigned char *const end = in + size;
+    uint32_t h = 0;
+
+    if (size >= 16) {
+        uint32_t acc[4] = {prime1 + prime2, prime2, 0, 0U - prime1};
+        for (; end - in >= 16; in += 16) {
+            for (size_t lane = 0; lane < 4; ++lane) {
+                acc[lane] = rotl32(acc[lane] + Lz::read32(in + 4 * lane) * prime2, 13) * prime1;
+            }
+        }
+        h = rotl32(acc[0], 1) + rotl32(acc[1], 7) + rotl32(acc[2], 12) + rotl32(acc[3], 18);
+    } else {
+        h = prime5;
+    }
+    h += static_cast<uint32_t>(size);
+
+    for (; end - in >= 4; in += 4) {
+        h = rotl32(h + Lz::read32(in) * prime3, 17) * prime4;
+    }
+    for (; in < end; ++in) {
+        h = rotl32(h + *in * prime5, 11) * prime1;
+    }
+
+    h ^= h >> 15;
+    h *= prime2;
+    h ^= h >> 13;
+    h *= prime3;
+    h ^= h >> 16;
+    return h;
+}
+
+inline void fileHeader(char *out) {
+    std::memcpy(out, FILE_MAGIC.data(), FILE_MAGIC.size());
+    out[4] = static_cast<char>(VERSION);
+    out[5] = 0;
+    out[6] = 0;
+    out[7] = 0;
+}
+
+/**
+ * @brief encodeBlock
+ * @param data uncompressed data
+ * @param size data size
+ * @param out buffer of at least `BLOCK_HEADER_SIZE + Lz::compressBound(size)` bytes
+ * @return size of encoded block with header
+ *
+ * Compresses data and places block header before it. Data is stored as is if it does not
+ * compress.
+ */
+inline size_t encodeBlock(const char *data, size_t size, char *out) {
+    char *payload = out + BLOCK_HEADER_SIZE;
+    size_t stored = Lz::compress(data, size, payload, Lz::compressBound(size));
+    uint32_t flags = 0;
+    if (stored == 0 || stored >= size) {
+        std::memcpy(payload, data, size);
+        stored = size;
+        flags = STORED_RAW;
+    }
+
+    std::memcpy(out, BLOCK_MAGIC.data(), BLOCK_MAGIC.size());
+    write32(out + 4, static_cast<uint32_t>(size));
+    write32(out + 8, static_cast<uint32_t>(stored) | flags);
+    write32(out + 12, checksum(payload, stored));
+    return BLOCK_HEADER_SIZE + stored;
+}
+
+/**
+ * @brief The Reader class
+ *
+ * Reads blocks of compressed log file one by one. Stops at the first incomplete or damaged
+ * block, `offset` tells where it is.
+ */
+class Reader {
+public:
+    enum class status { Ok, End, Truncated, Corrupted };
+
+    explicit Reader(std::FILE *input)
+        : file(input) {}
+
+    /**
+     * @brief open
+     * @return false if file does not start with valid header
+     */
+    bool open() {
+        char header[FILE_HEADER_SIZE];
+        if (std::fread(header, 1, sizeof(header), file) != sizeof(header) ||
+            std::memcmp(header, FILE_MAGIC.data(), FILE_MAGIC.size()) != 0 ||
+            static_cast<uint8_t>(header[4]) != VERSION) {
+            return false;
+        }
+        pos = FILE_HEADER_SIZE;
+        return true;
+    }
+
+    /**
+     * @brief next
+     * @param out uncompressed data of the next block
+     * @return `status::Ok` if block was read, `status::End` at the end of file
+     */
+    status next(std::vector<char> &out) {
+        char header[BLOCK_HEADER_SIZE];
+        size_t got = std::fread(header, 1, sizeof(header), file);
+        if (got == 0) {
+            return status::End;
+        }
+        if (got != sizeof(header)) {
+            return status::Truncated;
+        }
+        if (std::memcmp(header, BLOCK_MAGIC.data(), BLOCK_MAGIC.size()) != 0) {
+            return status::Corrupted;
+        }
+
+        const size_t raw_size = read32(header + 4);
+        const uint32_t stored_field = read32(header + 8);
+        const size_t stored_size = stored_field & ~STORED_RAW;
+        const bool raw = (stored_field & STORED_RAW) != 0;
+        if (raw_size > MAX_BLOCK_SIZE || stored_size > Lz::compressBound(MAX_BLOCK_SIZE) ||
+            (raw && stored_size != raw_size)) {
+            return status::Corrupted;
+        }
+
+        stored.resize(stored_size);
+        if (std::fread(stored.data(), 1, stored_size, file) != stored_size) {
+            return status::Truncated;
+        }
+        if (checksum(stored.data(), stored_size) != read32(header + 12)) {
+            return status::Corrupted;
+        }
+
+        out.resize(raw_size);
+        if (raw) {
+            std::memcpy(out.data(), stored.data(), raw_size);
+        } else {
+            size_t written = 0;
+            if (!Lz::decompress(stored.data(), stored_size, out.data(), raw_size, written) ||
+                written != raw_size) {
+                return status::Corrupted;
+            }
+        }
+        pos += BLOCK_HEADER_SIZE + stored_size;
+        return status::Ok;
+    }
+
+    /**
+     * @brief offset
+     * @return file offset after the last block that was read
+     */
+    size_t offset() const { return pos; }
+
+private:
+    std::FILE *file;
+    size_t pos = 0;
+    std::vector<char> stored;
+};
+
+}  // namespace Frame
+}  // namespace Log
@@ -0,0 +1,255 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "log_frame.h"
+#include "logger_config.h"
+
+namespace Log {
+namespace Index {
+
+/**
+ * Sparse index written next to log file as "<path>.idx". Log file is split in blocks of about
+ * the same size that start and end on message boundary. Index has `HEADER_SIZE` bytes header:
+ * "CPLX" magic, format version, format of indexed file and reserved bytes. It is followed by
+ * `ENTRY_SIZE` bytes entry for every block:
+ *
+ *   u64 offset of block in log file
+ *   u32 size of block in log file
+ *   u32 bitmask of levels present in block, bit `1 << level`
+ *   i64 the earliest timestamp in block
+ *   i64 the latest timestamp in block
+ *
+ * All numbers are little endian. Entry is written once the end of its block is in log file.
+ * Parts of log file without entry (written before index was enabled, after the last complete
+ * block or after index write failed) are not described, readers have to scan them.
+ */
+
+static constexpr std::array<char, 4> MAGIC = {'C', 'P', 'L', 'X'};
+static constexpr uint8_t VERSION = 1;
+static constexpr size_t HEADER_SIZE = 8;
+static constexpr size_t ENTRY_SIZE = 32;
+
+/// content of indexed file
+enum class dataFormat : uint8_t {
+    /// plain text, block is range of bytes
+    Text = 0,
+    /// `CompressedFileSink` file, block is one compressed block, @see log_frame.h
+    Compressed = 1,
+};
+
+/**
+ * @brief The Entry struct
+ *
+ * Describes one block of log file
+ */
+struct Entry {
+    uint64_t offset = 0;
+    uint32_t size = 0;
+    uint32_t levels = 0;
+    int64_t first_time = 0;
+    int64_t last_time = 0;
+
+    /// accounts message of block
+    void add(level msgType, long timestamp) {
+        if (levels == 0) {
+            first_time = timestamp;
+            last_time = timestamp;
+        }
+        // messages from several threads are not strictly ordered by time
+        first_time = std::min<int64_t>(first_time, timestamp);
+        last_time = std::max<int64_t>(last_time, timestamp);
+        levels |= 1U << static_cast<unsigned>(msgType);
+    }
+
+    bool empty() const { return levels == 0; }
+
+    /**
+     * @brief matches
+     * @return true if block may contain messages of `levelMask` logged between `from` and `to`
+     */
+    bool matches(int64_t from, int64_t to, uint32_t levelMask) const {
+        return (levels & levelMask) != 0 && first_time <= to && last_time >= from;
+    }
+
+    /**
+     * @brief within
+     * @return true if all messages of block were logged between `from` and `to`
+     */
+    bool within(int64_t from, int64_t to) const { return first_time >= from && last_time <= to; }
+};
+
+inline std::string indexPath(const std::string &path) {
+    return path + ".idx";
+}
+
+inline void write64(char *out, uint64_t value) {
+    Frame::write32(out, static_cast<uint32_t>(value));
+    Frame::write32(out + 4, static_cast<uint32_t>(value >> 32));
+}
+
+inline uint64_t read64(const char *in) {
+    return Frame::read32(in) | (static_cast<uint64_t>(Frame::read32(in + 4)) << 32);
+}
+
+inline void encodeEntry(const Entry &entry, char *out) {
+    write64(out, entry.offset);
+    Frame::write32(out + 8, entry.size);
+    Frame::write32(out + 12, entry.levels);
+    write64(out + 16, static_cast<uint64_t>(entry.first_time));
+    write64(out + 24, static_cast<uint64_t>(entry.last_time));
+}
+
+inline Entry decodeEntry(const char *in) {
+    Entry entry;
+    entry.offset = read64(in);
+    entry.size = Frame::read32(in + 8);
+    entry.levels = Frame::read32(in + 12);
+    entry.first_time = static_cast<int64_t>(read64(in + 16));
+    entry.last_time = static_cast<int64_t>(read64(in + 24));
+    return entry;
+}
+
+/**
+ * @brief The Writer class
+ *
+ * Appends entries to index file. Used by background thread of file sink.
+ */
+class Writer {
+public:
+    Writer() = default;
+    Writer(const Writer &) = delete;
+    Writer &operator=(const Writer &) = delete;
+
+    ~Writer() { close(); }
+
+    /**
+     * @brief open
+     * @param path index file path
+     * @param format content of indexed file
+     * @param append keep entries of existing index, log file is appended too
+     * @return false if file can not be opened, entries are discarded then
+     */
+    bool open(const std::string &path, dataFormat format, bool append) {
+        close();
+        file = std::fopen(path.c_str(), append ? "r+b" : "wb");
+        if (file == nullptr && append) {
+            file = std::fopen(path.c_str(), "wb");
+        }
+        if (file == nullptr) {
+            return false;
+        }
+
+        std::array<char, HEADER_SIZE> header = {};
+        std::memcpy(header.data(), MAGIC.data(), MAGIC.size());
+        header[4] = static_cast<char>(VERSION);
+        header[5] = static_cast<char>(format);
+
+        if (append) {
+            std::array<char, HEADER_SIZE> existing = {};
+            std::fseek(file, 0, SEEK_END);
+            long size = std::ftell(file);
+            std::rewind(file);
+            if (size >= static_cast<long>(HEADER_SIZE) &&
+                std::fread(existing.data(), 1, existing.size(), file) == existing.size() &&
+                existing == header) {
+                // entry cut by crash is overwritten
+                long entries = (size - static_cast<long>(HEADER_SIZE)) / ENTRY_SIZE;
+                std::fseek(file, static_cast<long>(HEADER_SIZE) + entries * ENTRY_SIZE, SEEK_SET);
+                return true;
+            }
+            std::fclose(file);
+            file = std::fopen(path.c_str(), "wb");
+            if (file == nullptr) {
+                return false;
+            }
+        }
+        if (std::fwrite(header.data(), 1, header.size(), file) != header.size()) {
+            close();
+            return false;
+        }
+        std::fflush(file);
+        return true;
+    }
+
+    /**
+     * @brief add
+     * @return false if entry was not written, index is closed then and later entries are
+     * discarded, so it never has a gap or cut entry in the middle
+     */
+    bool add(const Entry &entry) {
+        if (file == nullptr) {
+            return false;
+        }
+        std::array<char, ENTRY_SIZE> buf;
+        encodeEntry(entry, buf.data());
+        if (std::fwrite(buf.data(), 1, buf.size(), file) != buf.size()) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief flush
+     * @return false if added entries did not reach the kernel, index is closed then
+     */
+    bool flush() {
+        if (file == nullptr) {
+            return false;
+        }
+        if (std::fflush(file) != 0) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+        if (file != nullptr) {
+            std::fclose(file);
+            file = nullptr;
+        }
+    }
+
+private:
+    std::FILE *file = nullptr;
+};
+
+/**
+ * @brief read
+ * @param input index file
+ * @param format content of indexed file
+ * @param entries index entries sorted by offset, incomplete last entry is skipped
+ * @return false if file is not an index
+ */
+inline bool read(std::FILE *input, dataFormat &format, std::vector<Entry> &entries) {
+    std::array<char, HEADER_SIZE> header;
+    if (std::fread(header.data(), 1, header.size(), input) != header.size() ||
+        std::memcmp(header.data(), MAGIC.data(), MAGIC.size()) != 0 ||
+        static_cast<uint8_t>(header[4]) != VERSION ||
+        static_cast<uint8_t>(header[5]) > static_cast<uint8_t>(dataFormat::Compressed)) {
+        return false;
+    }
+    format = static_cast<dataFormat>(header[5]);
+
+    entries.clear();
+    std::array<char, ENTRY_SIZE> buf;
+    while (std::fread(buf.data(), 1, buf.size(), input) == buf.size()) {
+        entries.push_back(decodeEntry(buf.data()));
+    }
+    // blocks written concurrently may complete out of order
+    std::sort(entries.begin(), entries.end(),
+              [](const Entry &a, const Entry &b) { return a.offset < b.offset; });
+    return true;
+}
+
+}  // namespace Index
+}  // namespace Log
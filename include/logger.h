@@ -1,18 +1,25 @@
 #ifndef LOGGER_H
 #define LOGGER_H
 
+#include <algorithm>
+#include <cstdint>
 #include <cstring>
 #include <charconv>
 #include <tuple>
 #include <array>
 #include <string_view>
 #include <functional>
+#include <cmath>
+#include <type_traits>
 
 #define FMT_THROW(x) abort()
 #include "fmt/base.h"
 
 #include "logger_config.h"
 #include "message.h"
+#include "text_escape.h"
+#include "fast_format.h"
+#include "hex_dump.h"
 
 #if defined(__GNUC__) || defined(__clang__)
     #define LOG_CURRENT_FUNC __PRETTY_FUNCTION__
@@ -22,23 +29,130 @@
     #define LOG_CURRENT_FUNC __func__
 #endif
 
+/// Call site of logging macro. Offsets of short file and function names are template arguments,
+/// so they are always computed during compilation
+#define LOG_SOURCE_LOCATION                                                                      \
+    Log::SourceLocation(                                                                         \
+        __FILE__, LOG_CURRENT_FUNC, __LINE__,                                                    \
+        std::integral_constant<size_t, Log::fileBaseOffset(__FILE__)>::value,                    \
+        std::integral_constant<size_t, Log::funcShortRange(LOG_CURRENT_FUNC).begin>::value,      \
+        std::integral_constant<size_t, Log::funcShortRange(LOG_CURRENT_FUNC).end>::value)
+
+/// Cache of pre-rendered static part of message owned by call site. Every macro expansion creates
+/// its own lambda, so every call site gets its own constant-initialized static object
+#define LOG_SITE_CACHE(LoggerType)                                                                 \
+    []() {                                                                                         \
+        static Log::SiteCache<typename std::decay_t<decltype(LoggerType)>::TConfig> site_cache;    \
+        return &site_cache;                                                                        \
+    }()
+
+#define LOG_CONCAT_IMPL(a, b) a##b
+#define LOG_CONCAT(a, b) LOG_CONCAT_IMPL(a, b)
+
+/// Measures time until the end of enclosing scope and logs it as span, @see Log::Scope
+#define LOG_SCOPE(LoggerType, name)                                                              \
+    Log::Scope<std::decay_t<decltype(LoggerType)>> LOG_CONCAT(log_scope_, __LINE__)(           \
+        LoggerType, name, LOG_SOURCE_LOCATION, LOG_SITE_CACHE(LoggerType))
+
 #define Debug(LoggerType, fmt, ...) \
-    LoggerType.debug(fmt, __FILE__, LOG_CURRENT_FUNC, __LINE__, ##__VA_ARGS__)
+    LoggerType.debug(fmt, LOG_SOURCE_LOCATION, LOG_SITE_CACHE(LoggerType), ##__VA_ARGS__)
 #define Info(LoggerType, fmt, ...) \
-    LoggerType.info(fmt, __FILE__, LOG_CURRENT_FUNC, __LINE__, ##__VA_ARGS__)
+    LoggerType.info(fmt, LOG_SOURCE_LOCATION, LOG_SITE_CACHE(LoggerType), ##__VA_ARGS__)
 #define Warning(LoggerType, fmt, ...) \
-    LoggerType.warning(fmt, __FILE__, LOG_CURRENT_FUNC, __LINE__, ##__VA_ARGS__)
+    LoggerType.warning(fmt, LOG_SOURCE_LOCATION, LOG_SITE_CACHE(LoggerType), ##__VA_ARGS__)
 #define Error(LoggerType, fmt, ...) \
-    LoggerType.error(fmt, __FILE__, LOG_CURRENT_FUNC, __LINE__, ##__VA_ARGS__)
+    LoggerType.error(fmt, LOG_SOURCE_LOCATION, LOG_SITE_CACHE(LoggerType), ##__VA_ARGS__)
 #define Fatal(LoggerType, fmt, ...) \
-    LoggerType.fatal(fmt, __FILE__, LOG_CURRENT_FUNC, __LINE__, ##__VA_ARGS__)
+    LoggerType.fatal(fmt, LOG_SOURCE_LOCATION, LOG_SITE_CACHE(LoggerType), ##__VA_ARGS__)
+
+/// Logs title and hex dump of binary blob, @see Log::Logger::logBytes
+#define LogBytes(LoggerType, lev, title, data, size) \
+    LoggerType.logBytes(lev, title, data, size, LOG_SOURCE_LOCATION, LOG_SITE_CACHE(LoggerType))
 
 namespace Log {
+/**
+ * @brief The ILogSink class
+ *
+ * Sink receives rendered messages with `send`. Sink that owns output buffer may set
+ * `supportsReserve` and implement `reserveImpl` and `commitImpl`, then logger renders message
+ * directly in its buffer instead of copying it there, when it is the only sink of logger and there
+ * is no user callback. Nothing else runs between `reserve` and `commit`. Sink that sets
+ * `usesTimestamp` gets message timestamp as additional argument of `sendImpl` and `commitImpl`.
+ * Sink that sets `usesSpans` gets spans measured by `LOG_SCOPE` with `spanImpl` instead of their
+ * messages. Sink that sets `usesRecords` gets only call site and level of every message with
+ * `recordImpl`, if all sinks of logger do so, messages are not formatted.
+ */
 template <typename Derived>
 class ILogSink {
 public:
+    /// true if sink implements `reserveImpl` and `commitImpl`
+    static constexpr bool supportsReserve = false;
+    /// true if `sendImpl` and `commitImpl` take message timestamp after level
+    static constexpr bool usesTimestamp = false;
+    /// true if sink implements `spanImpl`
+    static constexpr bool usesSpans = false;
+    /// true if sink implements `recordImpl` and never gets message text
+    static constexpr bool usesRecords = false;
+
     void send(const level msgType, const char *data, size_t size) const {
-        static_cast<const Derived *>(this)->sendImpl(msgType, data, size);
+        send(msgType, 0, data, size);
+    }
+
+    /**
+     * @brief send
+     * @param msgType log level
+     * @param timestamp message timestamp from context provider
+     * @param data rendered message
+     * @param size message length
+     */
+    void send(const level msgType, long timestamp, const char *data, size_t size) const {
+        if constexpr (Derived::usesTimestamp) {
+            static_cast<const Derived *>(this)->sendImpl(msgType, timestamp, data, size);
+        } else {
+            static_cast<const Derived *>(this)->sendImpl(msgType, data, size);
+        }
+    }
+
+    /**
+     * @brief reserve
+     * @param size number of bytes logger may write
+     * @return sink buffer of `size` bytes or nullptr if sink can not take message now, logger
+     * calls `send` then
+     */
+    char *reserve(size_t size) const {
+        return static_cast<const Derived *>(this)->reserveImpl(size);
+    }
+
+    /**
+     * @brief commit
+     * @param msgType log level
+     * @param timestamp message timestamp from context provider
+     * @param data buffer returned by `reserve`
+     * @param size length of rendered message, it is followed by terminating zero
+     */
+    void commit(const level msgType, long timestamp, char *data, size_t size) const {
+        if constexpr (Derived::usesTimestamp) {
+            static_cast<const Derived *>(this)->commitImpl(msgType, timestamp, data, size);
+        } else {
+            static_cast<const Derived *>(this)->commitImpl(msgType, data, size);
+        }
+    }
+
+    /**
+     * @brief span
+     * @param record call site of `LOG_SCOPE` and span level
+     * @param span measured interval
+     */
+    void span(const LogRecord &record, const Span &span) const {
+        static_cast<const Derived *>(this)->spanImpl(record, span);
+    }
+
+    /**
+     * @brief record
+     * @param record call site and level of message
+     */
+    void record(const LogRecord &record) const {
+        static_cast<const Derived *>(this)->recordImpl(record);
     }
 };
 
@@ -46,8 +160,7 @@ public:
  * @brief The Logger class
  *
  * Main logging class. Uses DataProvider implemented by user to get platform-specific data.
- *
- * @todo Add queue interface to implement async work
+ * Rendering can be moved to background thread with `AsyncBackend`.
  */
 template <typename TContextProvider,
           typename ConfigTag = Config::Traits<Config::Default>,
@@ -57,6 +170,37 @@ public:
     using TConfig = Log::Config::Traits<ConfigTag>;
     using CallbackType = std::function<void(const level, const char *, size_t)>;
     using TMessage = LogMessage<TConfig>;
+    using QueueHandlerType = bool (*)(void *, const TMessage &);
+    using QueueReserveType = TMessage *(*)(void *);
+    using QueueCommitType = void (*)(void *);
+    using TSiteCache = SiteCache<TConfig>;
+    using TArena = PayloadArena<TConfig>;
+    using TProvider = TContextProvider;
+    using TSinks = std::tuple<TSinkTypes...>;
+
+    /// Maximum length of dump printed by `logBytes`
+    static constexpr size_t maxDumpSize =
+        Dump::formattedSize(HexDump{nullptr, TConfig::LOGGER_MAX_DUMP_SIZE, SIZE_MAX});
+
+    /// Size of buffer message is rendered to, messages spilled to arena may take
+    /// `LOGGER_MAX_PAYLOAD_SIZE` and dump of `logBytes` `maxDumpSize` in addition to pattern text
+    static constexpr size_t renderBufferSize =
+        TConfig::LOGGER_MAX_STR_SIZE + maxDumpSize +
+        (TConfig::ENABLE_PAYLOAD_SPILL ? TConfig::LOGGER_MAX_PAYLOAD_SIZE : 0);
+
+    /// Maximum length of user message, the same for stored and directly formatted message
+    static constexpr size_t maxMessageSize = TConfig::ENABLE_PAYLOAD_SPILL
+                                                 ? TConfig::LOGGER_MAX_PAYLOAD_SIZE
+                                                 : TConfig::LOGGER_MAX_FORMAT_SIZE;
+
+    /// True if all sinks take records only, messages are neither formatted nor rendered then
+    static constexpr bool recordsOnly =
+        sizeof...(TSinkTypes) != 0 && (TSinkTypes::usesRecords && ...);
+
+    /// Room for dumps in directly formatted message in addition to `maxMessageSize`
+    template <typename... Args>
+    static constexpr size_t dumpRoom =
+        (static_cast<size_t>(std::is_same_v<std::decay_t<Args>, HexDump>) + ... + 0) * maxDumpSize;
 
     explicit Logger(const TContextProvider &provider, TSinkTypes... sink_args) noexcept
         : data_provider_instance(provider),
@@ -84,6 +228,21 @@ public:
      */
     int getLevel() const { return logLevel; }
 
+    /**
+     * @brief setName
+     * @param name logger name printed by "%{logger}" token, text is not copied and must outlive
+     * logger
+     *
+     * Names component of application the logger belongs to, @see Registry
+     */
+    void setName(std::string_view name) { loggerName = name; }
+
+    /**
+     * @brief name
+     * @return logger name, empty if it was not set
+     */
+    std::string_view name() const { return loggerName; }
+
     /**
      * @brief setLogPattern
      * @param pattern Output message pattern
@@ -91,12 +250,19 @@ public:
      * Define ouput logging message format to look like.
      * Options : "%{date}"; "%{time}"; "%{level}"; "%{file}"; "%{thread}";
      * "%{function}"; "%{line}"; "%{pid}"; "%{message}".
+     * "%{file_base}" and "%{func_short}" are file name and function name without signature,
+     * both computed at compile time. "%{logger}" is logger name, @see setName.
+     * Structured output: "%{json}" renders whole message with `kv` fields as JSON line,
+     * "%{logfmt}" renders it as logfmt line.
      * @example "%{date} %{time}"
      * Output: "<current date> <current time>"
      * All text after the last token would be ignored.
      */
     bool setLogPattern(const char *pattern) {
+        patternId = patternIdOf(pattern);
         tokenOpsCount = 0;
+        dynamicTokens = 0;
+        directMessage = true;
         size_t literal_buffer_pos = 0;
 
         const char *p = pattern;
@@ -145,6 +311,12 @@ public:
                 }
             }
 
+            if (found_type == tokType::TokJson || found_type == tokType::TokLogfmt) {
+                directMessage = false;
+            }
+            if (!isStaticToken(found_type)) {
+                ++dynamicTokens;
+            }
             tokenOps[tokenOpsCount] = {found_type, dest, literal_len};
             ++tokenOpsCount;
             p = brace_end + 1;
@@ -155,114 +327,179 @@ public:
 
     void setUserHandler(const CallbackType &_handler) { userHandler = _handler; }
 
+    /**
+     * @brief setQueueHandler
+     * @param handler function that takes captured message to process it in background
+     * @param context pointer passed to handlers as first argument
+     * @param reserve optional function that returns free queue slot or nullptr, message is
+     * formatted in the slot and published with `commit`. `handler` is used if there is no slot
+     * @param commit publishes message placed in slot returned by `reserve`
+     *
+     * Used by `AsyncBackend` to receive messages instead of rendering them in caller thread
+     * (enabled only if `ENABLE_ASYNC` is true). Pass nullptr to log synchronously again.
+     */
+    void setQueueHandler(QueueHandlerType handler,
+                         void *context,
+                         QueueReserveType reserve = nullptr,
+                         QueueCommitType commit = nullptr) {
+        queueContext = context;
+        queueReserve = reserve;
+        queueCommit = commit;
+        queueHandler = handler;
+    }
+
+    /**
+     * @brief prepareThread
+     * @return false if thread state could not be allocated
+     *
+     * Allocates state used by logging calls of calling thread, `PayloadArena` with
+     * `ENABLE_PAYLOAD_SPILL`. Logging calls never allocate, so call it at thread start: long
+     * messages of thread without arena are truncated to `LOGGER_MAX_FORMAT_SIZE`.
+     */
+    bool prepareThread() const {
+        if constexpr (TConfig::ENABLE_PAYLOAD_SPILL) {
+            return TArena::attach();
+        }
+        return true;
+    }
+
+    /**
+     * @brief truncated
+     * @return number of user messages cut to fit in message buffer, for all loggers of this type
+     *
+     * Cut message ends with "...", @see markTruncated
+     */
+    static size_t truncated() { return truncatedCounter().load(std::memory_order_relaxed); }
+
     /**
      * @brief fatal
      */
     template <typename... Args>
     void fatal(const fmt::format_string<Args...> &fmt,
-               const std::string_view &file,
-               const std::string_view &func,
-               const size_t line,
+               const SourceLocation &loc,
+               TSiteCache *site,
                Args &&...args) const {
         if constexpr (TConfig::FATAL_ENABLED) {
             if (logLevel > static_cast<int>(level::FatalMsg)) {
-                LogMessage<TConfig> msg{.record{level::FatalMsg, file, func, line},
-                                        .user_data = {},
-                                        .user_data_len = 0,
-                                        .timestamp = data_provider_instance.getTimestamp()};
-
-                auto res = fmt::format_to_n(msg.user_data.data(), msg.user_data.size(), fmt,
-                                            std::forward<Args>(args)...);
-                msg.user_data_len = res.size;
-                log(msg);
+                write(level::FatalMsg, Span(), nullptr, fmt, loc, site,
+                      std::forward<Args>(args)...);
             }
         }
     }
 
     template <typename... Args>
     void error(const fmt::format_string<Args...> &fmt,
-               const std::string_view &file,
-               const std::string_view &func,
-               const size_t line,
+               const SourceLocation &loc,
+               TSiteCache *site,
                Args &&...args) const {
         if constexpr (TConfig::FATAL_ENABLED) {
             if (logLevel > static_cast<int>(level::ErrorMsg)) {
-                LogMessage<TConfig> msg{.record{level::ErrorMsg, file, func, line},
-                                        .user_data = {},
-                                        .user_data_len = 0,
-                                        .timestamp = data_provider_instance.getTimestamp()};
-
-                auto res = fmt::format_to_n(msg.user_data.data(), msg.user_data.size(), fmt,
-                                            std::forward<Args>(args)...);
-                msg.user_data_len = res.size;
-                log(msg);
+                write(level::ErrorMsg, Span(), nullptr, fmt, loc, site,
+                      std::forward<Args>(args)...);
             }
         }
     }
 
     template <typename... Args>
     void warning(const fmt::format_string<Args...> &fmt,
-                 const std::string_view &file,
-                 const std::string_view &func,
-                 const size_t line,
+                 const SourceLocation &loc,
+                 TSiteCache *site,
                  Args &&...args) const {
         if constexpr (TConfig::FATAL_ENABLED) {
             if (logLevel > static_cast<int>(level::WarningMsg)) {
-                LogMessage<TConfig> msg{.record{level::WarningMsg, file, func, line},
-                                        .user_data = {},
-                                        .user_data_len = 0,
-                                        .timestamp = data_provider_instance.getTimestamp()};
-
-                auto res = fmt::format_to_n(msg.user_data.data(), msg.user_data.size(), fmt,
-                                            std::forward<Args>(args)...);
-                msg.user_data_len = res.size;
-                log(msg);
+                write(level::WarningMsg, Span(), nullptr, fmt, loc, site,
+                      std::forward<Args>(args)...);
             }
         }
     }
 
     template <typename... Args>
     void info(const fmt::format_string<Args...> &fmt,
-              const std::string_view &file,
-              const std::string_view &func,
-              const size_t line,
+              const SourceLocation &loc,
+              TSiteCache *site,
               Args &&...args) const {
         if constexpr (TConfig::FATAL_ENABLED) {
             if (logLevel > static_cast<int>(level::InfoMsg)) {
-                LogMessage<TConfig> msg{.record{level::InfoMsg, file, func, line},
-                                        .user_data = {},
-                                        .user_data_len = 0,
-                                        .timestamp = data_provider_instance.getTimestamp()};
-
-                auto res = fmt::format_to_n(msg.user_data.data(), msg.user_data.size(), fmt,
-                                            std::forward<Args>(args)...);
-                msg.user_data_len = res.size;
-                log(msg);
+                write(level::InfoMsg, Span(), nullptr, fmt, loc, site, std::forward<Args>(args)...);
             }
         }
     }
 
     template <typename... Args>
     void debug(const fmt::format_string<Args...> &fmt,
-               const std::string_view &file,
-               const std::string_view &func,
-               const size_t line,
+               const SourceLocation &loc,
+               TSiteCache *site,
                Args &&...args) const {
         if constexpr (TConfig::FATAL_ENABLED) {
             if (logLevel > static_cast<int>(level::DebugMsg)) {
-                LogMessage<TConfig> msg{.record{level::DebugMsg, file, func, line},
-                                        .user_data = {},
-                                        .user_data_len = 0,
-                                        .timestamp = data_provider_instance.getTimestamp()};
-
-                auto res = fmt::format_to_n(msg.user_data.data(), msg.user_data.size(), fmt,
-                                            std::forward<Args>(args)...);
-                msg.user_data_len = res.size;
-                log(msg);
+                write(level::DebugMsg, Span(), nullptr, fmt, loc, site,
+                      std::forward<Args>(args)...);
             }
         }
     }
 
+    /**
+     * @brief logBytes
+     * @param lev message level
+     * @param title text before dump
+     * @param data blob to print
+     * @param size blob size, only `LOGGER_MAX_DUMP_SIZE` bytes are printed
+     * @param loc call site
+     * @param site call site cache
+     *
+     * Logs "<title> (<size> bytes)" followed by lines of hex dump and new line, @see HexDump.
+     * Printed bytes are copied to stored message and formatted when it is rendered, so dump is
+     * never cut by `LOGGER_MAX_FORMAT_SIZE`
+     */
+    void logBytes(level lev,
+                  std::string_view title,
+                  const void *data,
+                  size_t size,
+                  const SourceLocation &loc,
+                  TSiteCache *site) const {
+        if (static_cast<int>(lev) > TConfig::LOGGER_MAX_LEVEL ||
+            logLevel <= static_cast<int>(lev)) {
+            return;
+        }
+        const HexDump dump{static_cast<const unsigned char *>(data),
+                           std::min(size, TConfig::LOGGER_MAX_DUMP_SIZE), size};
+        write(lev, Span(), &dump, "{} ({} bytes)", loc, site, title, size);
+    }
+
+    /**
+     * @brief spanEnabled
+     * @return true if spans are logged at current level, `LOG_SCOPE` does not read clock otherwise
+     */
+    bool spanEnabled() const {
+        if constexpr (TConfig::LOGGER_MAX_LEVEL >= static_cast<int>(TConfig::LOGGER_SPAN_LEVEL)) {
+            return logLevel > static_cast<int>(TConfig::LOGGER_SPAN_LEVEL);
+        }
+        return false;
+    }
+
+    /// current span time, @see IContextProvider::getSpanTime
+    long long spanTime() const { return data_provider_instance.getSpanTime(); }
+
+    /**
+     * @brief span
+     * @param name span name
+     * @param begin start of span from `spanTime`
+     * @param loc call site
+     * @param site call site cache
+     *
+     * Logs span that ends now as "<name> <duration> us" message of `LOGGER_SPAN_LEVEL`. Sinks
+     * that set `usesSpans` get the span itself.
+     */
+    void span(std::string_view name,
+              long long begin,
+              const SourceLocation &loc,
+              TSiteCache *site) const {
+        const long long end = spanTime();
+        const Span measured{name, begin, end, currentThreadId()};
+        write(TConfig::LOGGER_SPAN_LEVEL, measured, nullptr, "{} {} us", loc, site, name,
+              (end - begin) / 1000);
+    }
+
     /**
      * @brief log
      * @param msg
@@ -271,65 +508,25 @@ public:
      * `logger_config.h`. All logging calls can be disabled in the same file.
      */
     void log(const TMessage &msg) const {
-        std::array<char, TConfig::LOGGER_MAX_STR_SIZE> finaL_msg;
-        size_t msg_size = createMessage(finaL_msg.data(), msg);
+        emit(msg, [this, &msg](size_t &pos, char *outBuf, size_t bufSize) {
+            tokMessageHandler(pos, outBuf, bufSize, msg, data_provider_instance);
+        });
 
-        if constexpr (TConfig::ENABLE_SINKS) {
-            send_to_all_sinks(msg.record.msgType, finaL_msg.data(), msg_size);
-        }
-
-        if constexpr (TConfig::ENABLE_PRINT_CALLBACK) {
-            if (userHandler != nullptr) {
-                userHandler(msg.record.msgType, finaL_msg.data(), msg_size);
-            }
+        if constexpr (TConfig::ENABLE_PAYLOAD_SPILL) {
+            msg.releaseSpill();
         }
     }
 
+    /**
+     * @brief createMessage
+     * @param outBuf buffer of `renderBufferSize` bytes
+     * @param msg captured message
+     * @return length of rendered message
+     */
     size_t createMessage(char *outBuf, const TMessage &msg) const {
-        size_t pos = 0;
-        size_t bufSize = TConfig::LOGGER_MAX_STR_SIZE;
-
-        for (size_t i = 0; i < tokenOpsCount; i++) {
-            append(pos, outBuf, bufSize, tokenOps[i].literal, tokenOps[i].literal_len);
-            switch (tokenOps[i].type) {
-                case tokType::TokDate:
-                    tokDateHandler(pos, outBuf, bufSize, msg, data_provider_instance);
-                    break;
-                case tokType::TokTime:
-                    tokTimeHandler(pos, outBuf, bufSize, msg, data_provider_instance);
-                    break;
-                case tokType::TokLevel:
-                    tokLevelHandler(pos, outBuf, bufSize, msg, data_provider_instance);
-                    break;
-                case tokType::TokFile:
-                    tokFileHandler(pos, outBuf, bufSize, msg, data_provider_instance);
-                    break;
-                case tokType::TokThread:
-                    tokThreadHandler(pos, outBuf, bufSize, msg, data_provider_instance);
-                    break;
-                case tokType::TokFunc:
-                    tokFuncHandler(pos, outBuf, bufSize, msg, data_provider_instance);
-                    break;
-                case tokType::TokLine:
-                    tokLineHandler(pos, outBuf, bufSize, msg, data_provider_instance);
-                    break;
-                case tokType::TokPid:
-                    tokPidHandler(pos, outBuf, bufSize, msg, data_provider_instance);
-                    break;
-                case tokType::TokMessage:
-                    tokMessageHandler(pos, outBuf, bufSize, msg, data_provider_instance);
-                    break;
-                case tokType::TokInvalid:
-                    tokInvalidHandler(pos, outBuf, bufSize, msg, data_provider_instance);
-                    break;
-                default:
-                    break;
-            }
-        }
-
-        outBuf[pos] = '\0';
-
-        return pos;
+        return render(outBuf, msg, [this, &msg](size_t &pos, char *buf, size_t bufSize) {
+            tokMessageHandler(pos, buf, bufSize, msg, data_provider_instance);
+        });
     }
 
 private:
@@ -343,6 +540,11 @@ private:
         TokLine,
         TokPid,
         TokMessage,
+        TokFileBase,
+        TokFuncShort,
+        TokJson,
+        TokLogfmt,
+        TokLogger,
         TokInvalid
     };
 
@@ -360,6 +562,404 @@ private:
         size_t literal_len;
     };
 
+    /**
+     * @brief isStaticToken
+     * @param type token type
+     * @return true if token output depends only on call site and level, so it can be cached.
+     * Level is part of cache id, @see siteCacheId
+     */
+    static constexpr bool isStaticToken(tokType type) {
+        switch (type) {
+            case tokType::TokLevel:
+            case tokType::TokFile:
+            case tokType::TokFunc:
+            case tokType::TokLine:
+            case tokType::TokFileBase:
+            case tokType::TokFuncShort:
+            case tokType::TokInvalid:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    /**
+     * @brief render
+     * @param outBuf buffer of `renderBufferSize` bytes
+     * @param msg captured message
+     * @param writeMessage places user message for "%{message}" token,
+     * `void(size_t &pos, char *outBuf, size_t bufSize)`
+     * @return length of rendered message
+     */
+    template <typename TWriter>
+    size_t render(char *outBuf, const TMessage &msg, const TWriter &writeMessage) const {
+        size_t pos = 0;
+        size_t bufSize = renderBufferSize;
+
+        if constexpr (TConfig::ENABLE_SITE_CACHE) {
+            if (msg.site != nullptr && renderCached(pos, outBuf, msg, writeMessage)) {
+                outBuf[pos] = '\0';
+                return pos;
+            }
+        }
+
+        for (size_t i = 0; i < tokenOpsCount; i++) {
+            append(pos, outBuf, bufSize, tokenOps[i].literal, tokenOps[i].literal_len);
+            renderToken(tokenOps[i].type, pos, outBuf, bufSize, msg, writeMessage);
+        }
+
+        outBuf[pos] = '\0';
+
+        return pos;
+    }
+
+    template <typename TWriter>
+    void renderToken(tokType type,
+                     size_t &pos,
+                     char *outBuf,
+                     size_t bufSize,
+                     const TMessage &msg,
+                     const TWriter &writeMessage) const {
+        switch (type) {
+            case tokType::TokDate:
+                tokDateHandler(pos, outBuf, bufSize, msg, data_provider_instance);
+                break;
+            case tokType::TokTime:
+                tokTimeHandler(pos, outBuf, bufSize, msg, data_provider_instance);
+                break;
+            case tokType::TokLevel:
+                tokLevelHandler(pos, outBuf, bufSize, msg, data_provider_instance);
+                break;
+            case tokType::TokFile:
+                tokFileHandler(pos, outBuf, bufSize, msg, data_provider_instance);
+                break;
+            case tokType::TokThread:
+                tokThreadHandler(pos, outBuf, bufSize, msg, data_provider_instance);
+                break;
+            case tokType::TokFunc:
+                tokFuncHandler(pos, outBuf, bufSize, msg, data_provider_instance);
+                break;
+            case tokType::TokLine:
+                tokLineHandler(pos, outBuf, bufSize, msg, data_provider_instance);
+                break;
+            case tokType::TokPid:
+                tokPidHandler(pos, outBuf, bufSize, msg, data_provider_instance);
+                break;
+            case tokType::TokMessage:
+                writeMessage(pos, outBuf, bufSize);
+                break;
+            case tokType::TokFileBase:
+                tokFileBaseHandler(pos, outBuf, bufSize, msg, data_provider_instance);
+                break;
+            case tokType::TokFuncShort:
+                tokFuncShortHandler(pos, outBuf, bufSize, msg, data_provider_instance);
+                break;
+            case tokType::TokJson:
+                tokJsonHandler(pos, outBuf, bufSize, msg, data_provider_instance);
+                break;
+            case tokType::TokLogfmt:
+                tokLogfmtHandler(pos, outBuf, bufSize, msg, data_provider_instance);
+                break;
+            case tokType::TokLogger:
+                append(pos, outBuf, bufSize, loggerName.data(), loggerName.size());
+                break;
+            case tokType::TokInvalid:
+                tokInvalidHandler(pos, outBuf, bufSize, msg, data_provider_instance);
+                break;
+            default:
+                break;
+        }
+    }
+
+    /// size of static text cache of one call site
+    static constexpr size_t cacheSize = TConfig::LOGGER_SITE_CACHE_SIZE;
+
+    /**
+     * @brief fillSiteCache
+     * @param site call site cache, must be claimed by caller
+     * @param msg message from this call site
+     *
+     * Renders literals and static tokens of current pattern. Static text before every dynamic
+     * token ends at `site.ends[n]` for the n-th dynamic token. Marks cache as overflowed if static
+     * text does not fit in it.
+     */
+    template <typename TWriter>
+    void fillSiteCache(TSiteCache &site, const TMessage &msg, const TWriter &writeMessage) const {
+        std::array<char, TConfig::LOGGER_MAX_STR_SIZE> buf;
+        size_t bufSize = buf.size();
+        size_t pos = 0;
+        size_t seg = 0;
+
+        for (size_t i = 0; i < tokenOpsCount; i++) {
+            append(pos, buf.data(), bufSize, tokenOps[i].literal, tokenOps[i].literal_len);
+            if (isStaticToken(tokenOps[i].type)) {
+                renderToken(tokenOps[i].type, pos, buf.data(), bufSize, msg, writeMessage);
+            } else {
+                site.ends[seg++].store(static_cast<uint16_t>(std::min(pos, cacheSize)),
+                                       std::memory_order_relaxed);
+            }
+        }
+        site.ends[seg].store(static_cast<uint16_t>(std::min(pos, cacheSize)),
+                             std::memory_order_relaxed);
+
+        const bool fit = pos <= cacheSize;
+        for (size_t w = 0; fit && w * 8 < pos; ++w) {
+            uint64_t word = 0;
+            std::memcpy(&word, buf.data() + w * 8, std::min<size_t>(8, pos - w * 8));
+            site.data[w].store(word, std::memory_order_relaxed);
+        }
+        site.overflow.store(!fit, std::memory_order_relaxed);
+        site.pattern.store(siteCacheId(msg.record.msgType), std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief siteCacheId
+     * @param lev message level
+     * @return id of call site cache content. `logBytes` takes level at runtime, so one call site
+     * may log with several levels and cache is refilled when level changes
+     */
+    uint64_t siteCacheId(level lev) const {
+        const uint64_t id =
+            patternId ^ ((static_cast<uint64_t>(lev) + 1) * 0x9E3779B97F4A7C15ULL);
+        // 0 marks empty cache
+        return id == 0 ? 1 : id;
+    }
+
+    /**
+     * @brief renderCached
+     * @param pos position in output buffer
+     * @param outBuf output buffer
+     * @param msg message with call site cache
+     * @param writeMessage places user message, @see render
+     * @return false if cache can not be used, message should be rendered by token loop
+     *
+     * Copies pre-rendered static text of call site and renders only dynamic tokens. Cache is
+     * filled by the first thread that logs from this call site with current pattern. Readers
+     * take a copy of cache and use it only if cache sequence number did not change meanwhile, so
+     * text being refilled for another pattern is never used.
+     */
+    template <typename TWriter>
+    bool renderCached(size_t &pos,
+                      char *outBuf,
+                      const TMessage &msg,
+                      const TWriter &writeMessage) const {
+        TSiteCache &site = *msg.site;
+        uint64_t seq = site.seq.load(std::memory_order_acquire);
+        if ((seq & 1) != 0) {
+            return false;
+        }
+
+        if (site.pattern.load(std::memory_order_relaxed) != siteCacheId(msg.record.msgType)) {
+            if (!site.seq.compare_exchange_strong(seq, seq + 1, std::memory_order_acq_rel)) {
+                return false;
+            }
+            std::atomic_thread_fence(std::memory_order_release);
+            fillSiteCache(site, msg, writeMessage);
+            seq += 2;
+            site.seq.store(seq, std::memory_order_release);
+        }
+
+        std::array<uint16_t, TConfig::LOGGER_MAX_TOKENS + 1> ends;
+        std::array<uint64_t, TSiteCache::words> words;
+        const bool overflow = site.overflow.load(std::memory_order_relaxed);
+        for (size_t seg = 0; seg <= dynamicTokens; ++seg) {
+            ends[seg] = site.ends[seg].load(std::memory_order_relaxed);
+        }
+        const size_t len = std::min<size_t>(ends[dynamicTokens], cacheSize);
+        for (size_t w = 0; w * 8 < len; ++w) {
+            words[w] = site.data[w].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (overflow || site.seq.load(std::memory_order_relaxed) != seq) {
+            return false;
+        }
+
+        const char *text = reinterpret_cast<const char *>(words.data());
+        size_t bufSize = renderBufferSize;
+        size_t start = 0;
+        size_t seg = 0;
+        for (size_t i = 0; i < tokenOpsCount; i++) {
+            if (isStaticToken(tokenOps[i].type)) {
+                continue;
+            }
+            // pattern with colliding id may have left other segments
+            if (ends[seg] < start || ends[seg] > len) {
+                pos = 0;
+                return false;
+            }
+            append(pos, outBuf, bufSize, text + start, ends[seg] - start);
+            start = ends[seg++];
+            renderToken(tokenOps[i].type, pos, outBuf, bufSize, msg, writeMessage);
+        }
+        if (ends[seg] < start) {
+            pos = 0;
+            return false;
+        }
+        append(pos, outBuf, bufSize, text + start, ends[seg] - start);
+        return true;
+    }
+
+    /**
+     * @brief write
+     * @param lev message level
+     * @param span interval measured by `LOG_SCOPE`, empty for ordinary message
+     * @param blob blob passed to `logBytes`, its dump and new line follow user message
+     * @param fmt format string
+     * @param loc call site
+     * @param site call site cache
+     * @param args format arguments and `kv` fields
+     *
+     * Formats user message straight into its final place. With async backend it is the free
+     * slot of producer queue, if queue has one. Otherwise pattern is rendered in caller thread
+     * and `fmt` writes user message directly into rendered output, that is buffer of the first
+     * sink that supports `reserve` or stack buffer. Message is stored in `LogMessage` first only
+     * when pattern needs whole text for escaping ("%{json}", "%{logfmt}", `ENABLE_SANITIZE`).
+     */
+    template <typename... Args>
+    void write(level lev,
+               const Span &span,
+               const HexDump *blob,
+               const fmt::format_string<Args...> &fmt,
+               const SourceLocation &loc,
+               TSiteCache *site,
+               Args &&...args) const {
+        if constexpr (TConfig::ENABLE_SINKS && recordsOnly) {
+            if (!TConfig::ENABLE_PRINT_CALLBACK || userHandler == nullptr) {
+                record_to_all_sinks(LogRecord(lev, loc));
+                return;
+            }
+        }
+
+        const long timestamp = data_provider_instance.getTimestamp();
+
+        if constexpr (TConfig::ENABLE_ASYNC) {
+            if (queueHandler != nullptr) {
+                TMessage *slot = queueReserve != nullptr ? queueReserve(queueContext) : nullptr;
+                if (slot != nullptr) {
+                    slot->reset(lev, loc, timestamp, site, span);
+                    slot->source = this;
+                    formatMessage(*slot, fmt, std::forward<Args>(args)...);
+                    if (blob != nullptr) {
+                        slot->setDump(*blob);
+                    }
+                    queueCommit(queueContext);
+                    return;
+                }
+            }
+        }
+
+        TMessage msg;
+        msg.reset(lev, loc, timestamp, site, span);
+
+        if constexpr (!TConfig::ENABLE_SANITIZE) {
+            if (directMessage && (!TConfig::ENABLE_ASYNC || queueHandler == nullptr)) {
+                emit(msg, [&](size_t &pos, char *outBuf, size_t bufSize) {
+                    // keep room for terminating zero, length is limited as for stored message
+                    if (pos + 1 >= bufSize) {
+                        return;
+                    }
+                    size_t room =
+                        std::min(bufSize - pos - 1, maxMessageSize + dumpRoom<Args...>);
+                    size_t len = formatTo<Args...>(outBuf + pos, room, fmt, args...);
+                    if (len > room) {
+                        markTruncated(outBuf + pos, room, fmt);
+                        len = room;
+                    }
+                    pos += len;
+                    if (blob != nullptr) {
+                        appendDump(pos, outBuf, bufSize, *blob);
+                    }
+                });
+                return;
+            }
+        }
+
+        formatMessage(msg, fmt, std::forward<Args>(args)...);
+        if (blob != nullptr) {
+            msg.setDump(*blob);
+        }
+        if constexpr (TConfig::ENABLE_ASYNC) {
+            if (queueHandler != nullptr) {
+                msg.source = this;
+                queueHandler(queueContext, msg);
+                return;
+            }
+        }
+        log(msg);
+    }
+
+    /**
+     * @brief emit
+     * @param msg captured message
+     * @param writeMessage places user message, @see render
+     *
+     * Renders message once and passes it to all sinks and user callback. If the only receiver is
+     * sink that supports `reserve`, message is rendered in its buffer and committed. With more
+     * receivers message is rendered in stack buffer and sent to all of them, so no sink buffer
+     * stays reserved while other sinks or callback run.
+     */
+    template <typename TWriter>
+    void emit(const TMessage &msg, const TWriter &writeMessage) const {
+        constexpr size_t target = reserveSinkIndex();
+
+        if constexpr (TConfig::ENABLE_SINKS && sizeof...(TSinkTypes) == 1 && target == 0) {
+            using TSink = std::tuple_element_t<target, std::tuple<TSinkTypes...>>;
+            const bool span = TSink::usesSpans && msg.span.valid();
+            if (!span && !hasUserHandler()) {
+                const auto &sink = std::get<target>(sinks_tuple);
+                char *buf = sink.reserve(renderBufferSize);
+                if (buf != nullptr) {
+                    size_t size = render(buf, msg, writeMessage);
+                    sink.commit(msg.record.msgType, msg.timestamp, buf, size);
+                    return;
+                }
+            }
+        }
+
+        std::array<char, renderBufferSize> finaL_msg;
+        size_t msg_size = render(finaL_msg.data(), msg, writeMessage);
+
+        if constexpr (TConfig::ENABLE_SINKS) {
+            send_to_all_sinks(msg, finaL_msg.data(), msg_size);
+        }
+        callUserHandler(msg.record.msgType, finaL_msg.data(), msg_size);
+    }
+
+    /// true if user callback is set and enabled
+    bool hasUserHandler() const {
+        if constexpr (TConfig::ENABLE_PRINT_CALLBACK) {
+            return userHandler != nullptr;
+        }
+        return false;
+    }
+
+    void callUserHandler([[maybe_unused]] level msgType,
+                         [[maybe_unused]] const char *data,
+                         [[maybe_unused]] size_t size) const {
+        if constexpr (TConfig::ENABLE_PRINT_CALLBACK) {
+            if (userHandler != nullptr) {
+                userHandler(msgType, data, size);
+            }
+        }
+    }
+
+    /**
+     * @brief reserveSinkIndex
+     * @return index of the first sink that supports `reserve`, number of sinks if there is none
+     */
+    template <size_t I = 0>
+    static constexpr size_t reserveSinkIndex() {
+        if constexpr (I < sizeof...(TSinkTypes)) {
+            if constexpr (std::tuple_element_t<I, std::tuple<TSinkTypes...>>::supportsReserve) {
+                return I;
+            } else {
+                return reserveSinkIndex<I + 1>();
+            }
+        } else {
+            return I;
+        }
+    }
+
     /**
      * @brief append
      * @param pos position to place sting in outBuf
@@ -367,16 +967,19 @@ private:
      * @param bufSize size of buffer
      * @param data string to place in buffer
      * @param dataLen string length
+     * @return true if string was placed
      *
      * Places string in buffer in needed position and increase `pos` to `dataLen` if data is
      * placed.
      */
-    static void append(
+    static bool append(
         size_t &pos, char *outBuf, size_t bufSize, const char *data, size_t dataLen) {
         if (pos + dataLen < bufSize) {
             std::memcpy(outBuf + pos, data, dataLen);
             pos += dataLen;
+            return true;
         }
+        return false;
     }
 
     static void tokDateHandler(size_t &pos,
@@ -438,6 +1041,24 @@ private:
         append(pos, outBuf, bufSize, msg.record.func.data(), msg.record.func.size());
     }
 
+    static void tokFileBaseHandler(
+        size_t &pos,
+        char *outBuf,
+        size_t bufSize,
+        const TMessage &msg,
+        [[maybe_unused]] const TContextProvider &data_provider_instance) {
+        append(pos, outBuf, bufSize, msg.record.file_base.data(), msg.record.file_base.size());
+    }
+
+    static void tokFuncShortHandler(
+        size_t &pos,
+        char *outBuf,
+        size_t bufSize,
+        const TMessage &msg,
+        [[maybe_unused]] const TContextProvider &data_provider_instance) {
+        append(pos, outBuf, bufSize, msg.record.func_short.data(), msg.record.func_short.size());
+    }
+
     static void tokLineHandler(size_t &pos,
                                char *outBuf,
                                size_t bufSize,
@@ -454,7 +1075,390 @@ private:
                                   size_t bufSize,
                                   const TMessage &msg,
                                   [[maybe_unused]] const TContextProvider &data_provider_instance) {
-        append(pos, outBuf, bufSize, msg.user_data.data(), msg.user_data_len);
+        if constexpr (TConfig::ENABLE_SANITIZE) {
+            // trailing new line ends the record and is kept as is
+            std::string_view text = userText(msg);
+            if (pos + 2 >= bufSize) {
+                return;
+            }
+            pos += sanitizeText(outBuf + pos, bufSize - pos - 2, text.data(), text.size());
+            if (text.size() != msg.text().size()) {
+                outBuf[pos++] = '\n';
+            }
+        } else {
+            std::string_view text = msg.text();
+            append(pos, outBuf, bufSize, text.data(), text.size());
+        }
+        if (msg.dump_total != 0) {
+            appendDump(pos, outBuf, bufSize, msg.dump());
+        }
+    }
+
+    /**
+     * @brief appendDump
+     *
+     * Places lines of hex dump and new line after message of `logBytes`. Lines past the end of
+     * buffer are cut, new line is always placed
+     */
+    static void appendDump(size_t &pos, char *outBuf, size_t bufSize, const HexDump &dump) {
+        // room for new line and terminating zero
+        if (pos + 2 > bufSize) {
+            return;
+        }
+        const size_t room = bufSize - pos - 2;
+        pos += std::min(room, Dump::format(outBuf + pos, room, dump));
+        outBuf[pos++] = '\n';
+    }
+
+    /**
+     * @brief formatMessage
+     * @param msg message to store formatted text and fields in
+     * @param fmt format string
+     * @param args format arguments and `kv` fields
+     *
+     * Formats user message to `user_data`. With `ENABLE_PAYLOAD_SPILL` and arena attached by
+     * `prepareThread` message is formatted once, straight into arena block of
+     * `LOGGER_MAX_PAYLOAD_SIZE`. Short message is moved to `user_data` and block is returned,
+     * block of long one is shrunk to its length. Message is truncated to `user_data` if arena has
+     * no space.
+     */
+    template <typename... Args>
+    static void formatMessage(TMessage &msg,
+                              const fmt::format_string<Args...> &fmt,
+                              Args &&...args) {
+        if constexpr (TConfig::ENABLE_PAYLOAD_SPILL) {
+            TArena *arena = TArena::local();
+            if (arena != nullptr && formatSpilled(msg, *arena, fmt, args...)) {
+                captureFields(msg, args...);
+                return;
+            }
+        }
+
+        size_t size = formatTo<Args...>(msg.user_data.data(), msg.user_data.size(), fmt, args...);
+        msg.user_data_len = std::min(size, msg.user_data.size());
+        if (size > msg.user_data.size()) {
+            markTruncated(msg.user_data.data(), msg.user_data_len, fmt);
+        }
+
+        captureFields(msg, args...);
+    }
+
+    /**
+     * @brief formatSpilled
+     * @param msg message to store formatted text in
+     * @param arena arena of calling thread
+     * @return false if arena has no room for `LOGGER_MAX_PAYLOAD_SIZE` block
+     */
+    template <typename... Args>
+    static bool formatSpilled(TMessage &msg,
+                              TArena &arena,
+                              const fmt::format_string<Args...> &fmt,
+                              const Args &...args) {
+        constexpr size_t max_len = TConfig::LOGGER_MAX_PAYLOAD_SIZE;
+        typename TArena::Block *block = arena.allocate(max_len);
+        if (block == nullptr) {
+            return false;
+        }
+        size_t size = formatTo<Args...>(block->data(), max_len, fmt, args...);
+        if (size <= msg.user_data.size()) {
+            std::memcpy(msg.user_data.data(), block->data(), size);
+            msg.user_data_len = size;
+            arena.cancel(block);
+            return true;
+        }
+        if (size > max_len) {
+            markTruncated(block->data(), max_len, fmt);
+            size = max_len;
+        }
+        arena.shrink(block, size);
+        msg.spill = block;
+        return true;
+    }
+
+    /**
+     * @brief markTruncated
+     * @param text user message cut to `len` bytes
+     * @param len length of cut message
+     * @param fmt format string, cut message keeps its trailing new line
+     *
+     * Ends cut message with "..." and counts it, @see truncated
+     */
+    static void markTruncated(char *text, size_t len, fmt::string_view fmt) {
+        truncatedCounter().fetch_add(1, std::memory_order_relaxed);
+        const bool newline = fmt.size() != 0 && fmt.data()[fmt.size() - 1] == '\n';
+        const std::string_view marker = newline ? "...\n" : "...";
+        if (len >= marker.size()) {
+            std::memcpy(text + len - marker.size(), marker.data(), marker.size());
+        }
+    }
+
+    static std::atomic<size_t> &truncatedCounter() {
+        static std::atomic<size_t> counter = 0;
+        return counter;
+    }
+
+    /**
+     * @brief formatTo
+     * @return length of full formatted text, only `size` bytes of it are placed in `out`
+     *
+     * Formats with `Fast::formatTo` when all arguments and fields are supported by it,
+     * with fmt otherwise.
+     */
+    template <typename... Args>
+    static size_t formatTo(char *out,
+                           size_t size,
+                           const fmt::format_string<Args...> &fmt,
+                           const Args &...args) {
+        if constexpr (TConfig::ENABLE_FAST_FORMAT && Fast::supported<Args...>) {
+            const fmt::string_view text = fmt;
+            size_t len =
+                Fast::formatTo(out, size, std::string_view(text.data(), text.size()), args...);
+            if (len != Fast::unsupported) {
+                return len;
+            }
+        }
+        // format string was checked by caller, converting it to other `Args` would check it again
+        return fmt::vformat_to_n(out, size, fmt, fmt::make_format_args(args...)).size;
+    }
+
+    /**
+     * @brief captureFields
+     * @param msg message to store fields in
+     * @param args logging call arguments, only `Field` arguments are captured
+     */
+    template <typename... Args>
+    static void captureFields(TMessage &msg, const Args &...args) {
+        (captureField(msg, args), ...);
+    }
+
+    template <typename T>
+    static void captureField([[maybe_unused]] TMessage &msg, [[maybe_unused]] const T &arg) {
+        if constexpr (std::is_same_v<T, Field>) {
+            static_assert(TConfig::LOGGER_MAX_FIELDS != 0,
+                          "kv fields need LOGGER_MAX_FIELDS in logger traits");
+            msg.addField(arg);
+        }
+    }
+
+    /**
+     * @brief userText
+     * @param msg message
+     * @return formatted user message without trailing new line, structured renderers add their own
+     */
+    static std::string_view userText(const TMessage &msg) {
+        std::string_view text = msg.text();
+        if (!text.empty() && text.back() == '\n') {
+            text.remove_suffix(1);
+        }
+        return text;
+    }
+
+    template <typename T>
+    static bool appendNumber(size_t &pos, char *outBuf, size_t bufSize, T value) {
+        if (pos >= bufSize) {
+            return false;
+        }
+        char *first = outBuf + pos;
+        char *last = outBuf + bufSize - 1;
+        std::to_chars_result result = std::to_chars(first, last, value);
+        if (result.ec == std::errc()) {
+            pos += result.ptr - first;
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief appendQuoted
+     * @return true if whole string was placed
+     *
+     * Places string escaped for JSON in quotes. Closing quote is always placed.
+     */
+    static bool appendQuoted(
+        size_t &pos, char *outBuf, size_t bufSize, const char *data, size_t dataLen) {
+        if (pos + 2 >= bufSize) {
+            return false;
+        }
+        size_t consumed = 0;
+        outBuf[pos++] = '"';
+        pos += escapeJson(outBuf + pos, bufSize - pos - 2, data, dataLen, &consumed);
+        outBuf[pos++] = '"';
+        return consumed == dataLen;
+    }
+
+    /**
+     * @brief appendQuotedText
+     * @return true if whole text was placed
+     *
+     * Places user message as `appendQuoted` does, lines of hex dump of `logBytes` are part of it
+     */
+    static bool appendQuotedText(size_t &pos, char *outBuf, size_t bufSize, const TMessage &msg) {
+        std::string_view text = userText(msg);
+        if (msg.dump_total == 0) {
+            return appendQuoted(pos, outBuf, bufSize, text.data(), text.size());
+        }
+        std::array<char, maxDumpSize> dump;
+        const size_t dumpLen =
+            std::min(dump.size(), Dump::format(dump.data(), dump.size(), msg.dump()));
+        if (pos + 2 >= bufSize) {
+            return false;
+        }
+        size_t consumed = 0;
+        outBuf[pos++] = '"';
+        pos += escapeJson(outBuf + pos, bufSize - pos - 2, text.data(), text.size(), &consumed);
+        bool whole = consumed == text.size();
+        if (whole) {
+            pos += escapeJson(outBuf + pos, bufSize - pos - 2, dump.data(), dumpLen, &consumed);
+            whole = consumed == dumpLen;
+        }
+        outBuf[pos++] = '"';
+        return whole;
+    }
+
+    /**
+     * @brief appendFieldValue
+     *
+     * @return true if whole value was placed
+     *
+     * Places value of structured field. Strings are quoted in JSON and in logfmt when they
+     * contain spaces, '=' or characters that need escaping.
+     */
+    static bool appendFieldValue(size_t &pos,
+                                 char *outBuf,
+                                 size_t bufSize,
+                                 const TMessage &msg,
+                                 const Field &field,
+                                 bool json) {
+        switch (field.type) {
+            case fieldType::Int:
+                return appendNumber(pos, outBuf, bufSize, field.value.i);
+            case fieldType::Uint:
+                return appendNumber(pos, outBuf, bufSize, field.value.u);
+            case fieldType::Double:
+                if (json && !std::isfinite(field.value.d)) {
+                    return append(pos, outBuf, bufSize, "null", sizeof("null") - 1);
+                }
+                return appendNumber(pos, outBuf, bufSize, field.value.d);
+            case fieldType::Bool:
+                if (field.value.b) {
+                    return append(pos, outBuf, bufSize, "true", sizeof("true") - 1);
+                }
+                return append(pos, outBuf, bufSize, "false", sizeof("false") - 1);
+            case fieldType::String: {
+                std::string_view str = msg.fieldString(field);
+                if (json || needsLogfmtQuote(str)) {
+                    return appendQuoted(pos, outBuf, bufSize, str.data(), str.size());
+                }
+                return append(pos, outBuf, bufSize, str.data(), str.size());
+            }
+            default:
+                return true;
+        }
+    }
+
+    static bool needsLogfmtQuote(std::string_view str) {
+        return str.empty() || findJsonEscape(str.data(), str.size()) != str.size() ||
+               str.find_first_of(" =") != std::string_view::npos;
+    }
+
+    /**
+     * @brief tokJsonHandler
+     *
+     * Renders message as JSON object with "time", "level", "file", "line", "msg" and user fields
+     * followed by new line. Object is closed also when buffer is short: "msg" is cut and fields
+     * that do not fit are left out, if there is no room even for that, nothing is rendered.
+     */
+    static void tokJsonHandler(size_t &pos,
+                               char *outBuf,
+                               size_t bufSize,
+                               const TMessage &msg,
+                               const TContextProvider &data_provider_instance) {
+        // room for closing "}\n"
+        if (bufSize < 3) {
+            return;
+        }
+        const size_t start = pos;
+        const size_t limit = bufSize - 2;
+        bool fit = append(pos, outBuf, limit, "{\"time\":\"", sizeof("{\"time\":\"") - 1);
+        tokTimeHandler(pos, outBuf, limit - 1, msg, data_provider_instance);
+        fit = fit && append(pos, outBuf, limit, "\",\"level\":\"", sizeof("\",\"level\":\"") - 1);
+        tokLevelHandler(pos, outBuf, limit, msg, data_provider_instance);
+        fit = fit && append(pos, outBuf, limit, "\",\"file\":", sizeof("\",\"file\":") - 1);
+        appendQuoted(pos, outBuf, limit, msg.record.file.data(), msg.record.file.size());
+        fit = fit && append(pos, outBuf, limit, ",\"line\":", sizeof(",\"line\":") - 1);
+        fit = fit && appendNumber(pos, outBuf, limit, msg.record.line);
+        fit = fit && append(pos, outBuf, limit, ",\"msg\":", sizeof(",\"msg\":") - 1);
+        fit = fit && pos + 2 < limit;
+        if (!fit) {
+            pos = start;
+            return;
+        }
+        appendQuotedText(pos, outBuf, limit, msg);
+
+        for (size_t i = 0; i < msg.fields_count; ++i) {
+            const Field &field = msg.fields[i];
+            const size_t field_start = pos;
+            if (!append(pos, outBuf, limit, ",", 1) ||
+                !appendQuoted(pos, outBuf, limit, field.key.data(), field.key.size()) ||
+                !append(pos, outBuf, limit, ":", 1) ||
+                !appendFieldValue(pos, outBuf, limit, msg, field, true)) {
+                pos = field_start;
+                break;
+            }
+        }
+        append(pos, outBuf, bufSize, "}\n", 2);
+    }
+
+    /**
+     * @brief tokLogfmtHandler
+     *
+     * Renders message as logfmt "key=value" pairs with "time", "level", "file", "line", "msg" and
+     * user fields followed by new line. When buffer is short "msg" is cut and fields that do not
+     * fit are left out, if there is no room even for that, nothing is rendered.
+     */
+    static void tokLogfmtHandler(size_t &pos,
+                                 char *outBuf,
+                                 size_t bufSize,
+                                 const TMessage &msg,
+                                 const TContextProvider &data_provider_instance) {
+        // room for closing new line
+        if (bufSize < 2) {
+            return;
+        }
+        const size_t start = pos;
+        const size_t limit = bufSize - 1;
+        bool fit = append(pos, outBuf, limit, "time=", sizeof("time=") - 1);
+        tokTimeHandler(pos, outBuf, limit - 1, msg, data_provider_instance);
+        fit = fit && append(pos, outBuf, limit, " level=", sizeof(" level=") - 1);
+        tokLevelHandler(pos, outBuf, limit, msg, data_provider_instance);
+        fit = fit && append(pos, outBuf, limit, " file=", sizeof(" file=") - 1);
+        if (needsLogfmtQuote(msg.record.file)) {
+            appendQuoted(pos, outBuf, limit, msg.record.file.data(), msg.record.file.size());
+        } else {
+            tokFileHandler(pos, outBuf, limit, msg, data_provider_instance);
+        }
+        fit = fit && append(pos, outBuf, limit, " line=", sizeof(" line=") - 1);
+        fit = fit && appendNumber(pos, outBuf, limit, msg.record.line);
+        fit = fit && append(pos, outBuf, limit, " msg=", sizeof(" msg=") - 1);
+        fit = fit && pos + 2 < limit;
+        if (!fit) {
+            pos = start;
+            return;
+        }
+        appendQuotedText(pos, outBuf, limit, msg);
+
+        for (size_t i = 0; i < msg.fields_count; ++i) {
+            const Field &field = msg.fields[i];
+            const size_t field_start = pos;
+            if (!append(pos, outBuf, limit, " ", 1) ||
+                !append(pos, outBuf, limit, field.key.data(), field.key.size()) ||
+                !append(pos, outBuf, limit, "=", 1) ||
+                !appendFieldValue(pos, outBuf, limit, msg, field, false)) {
+                pos = field_start;
+                break;
+            }
+        }
+        append(pos, outBuf, bufSize, "\n", 1);
     }
 
     static void tokInvalidHandler([[maybe_unused]] size_t &pos,
@@ -473,6 +1477,14 @@ private:
     std::array<TokenOp, TConfig::LOGGER_MAX_TOKENS> tokenOps = {};
     /// number of found tokens
     size_t tokenOpsCount = 0;
+    /// id of current pattern, call site caches rendered for other patterns are refilled
+    uint64_t patternId = 0;
+    /// number of tokens rendered for every message, static ones come from call site cache
+    size_t dynamicTokens = 0;
+    /// pattern has no tokens that escape user message, so it can be formatted in output directly
+    bool directMessage = true;
+    /// printed by "%{logger}" token, @see setName
+    std::string_view loggerName;
 
     /// class that provides platform-dependent data
     TContextProvider data_provider_instance;
@@ -482,35 +1494,151 @@ private:
 
     /**
      * @brief send_to_all_sinks
-     * @param msgType log level
-     * @param data log message
+     * @param msg captured message
+     * @param data rendered log message
      * @param size size of log message
      * @return
      *
      * Recursively send log message to all user sinks
      */
     template <std::size_t I = 0>
-    void send_to_all_sinks(const level &msgType, const char *data, size_t size) const {
+    void send_to_all_sinks(const TMessage &msg, const char *data, size_t size) const {
         if constexpr (I < sizeof...(TSinkTypes)) {
             // call current sink
-            std::get<I>(sinks_tuple).send(msgType, data, size);
+            using TSink = std::tuple_element_t<I, std::tuple<TSinkTypes...>>;
+            const auto &sink = std::get<I>(sinks_tuple);
+            if constexpr (TSink::usesRecords) {
+                sink.record(msg.record);
+            } else if constexpr (TSink::usesSpans) {
+                if (msg.span.valid()) {
+                    sink.span(msg.record, msg.span);
+                } else {
+                    sink.send(msg.record.msgType, msg.timestamp, data, size);
+                }
+            } else {
+                sink.send(msg.record.msgType, msg.timestamp, data, size);
+            }
             // call next sink
-            send_to_all_sinks<I + 1>(msgType, data, size);
+            send_to_all_sinks<I + 1>(msg, data, size);
         }
     }
 
+    /// passes call site and level to all sinks, used when all of them take records only
+    void record_to_all_sinks(const LogRecord &record) const {
+        std::apply([&record](const auto &...sink) { (sink.record(record), ...); }, sinks_tuple);
+    }
+
     /// user callback to print logging message
     CallbackType userHandler;
 
-    /// types of logging level, added to output message
-    static constexpr std::array<std::string_view, 5> msg_log_types = {"FATAL", "ERROR", "WARN",
-                                                                      "INFO", "DEBUG"};
+    /// takes messages to process them in background, @see setQueueHandler
+    QueueHandlerType queueHandler = nullptr;
+    /// gives free queue slot to format message in, @see setQueueHandler
+    QueueReserveType queueReserve = nullptr;
+    /// publishes message formatted in slot from `queueReserve`
+    QueueCommitType queueCommit = nullptr;
+    /// context passed to `queueHandler`
+    void *queueContext = nullptr;
+
     /// tokens for message pattern
-    static constexpr std::array<std::string_view, 9> tokens = {
-        "%{date}",     "%{time}", "%{level}", "%{file}",   "%{thread}",
-        "%{function}", "%{line}", "%{pid}",   "%{message}"};
+    static constexpr std::array<std::string_view, 14> tokens = {
+        "%{date}",    "%{time}",      "%{level}",      "%{file}", "%{thread}",
+        "%{function}", "%{line}",     "%{pid}",        "%{message}", "%{file_base}",
+        "%{func_short}", "%{json}",   "%{logfmt}",     "%{logger}"};
+};
+
+/**
+ * @brief The Scope class
+ *
+ * Measures time between construction and destruction and logs it as span, created by
+ * `LOG_SCOPE`. If span level is disabled clock is not read and nothing is logged.
+ * @example void load() { LOG_SCOPE(logger, "load"); ... }
+ */
+template <typename TLogger>
+class Scope {
+public:
+    Scope(const TLogger &log,
+          std::string_view span_name,
+          const SourceLocation &loc,
+          typename TLogger::TSiteCache *site) noexcept
+        : logger(log.spanEnabled() ? &log : nullptr),
+          name(span_name),
+          location(loc),
+          site_cache(site) {
+        if (logger != nullptr) {
+            begin = logger->spanTime();
+        }
+    }
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+    ~Scope() {
+        if (logger != nullptr) {
+            logger->span(name, begin, location, site_cache);
+        }
+    }
+
+private:
+    /// nullptr if span is not logged
+    const TLogger *logger;
+    std::string_view name;
+    SourceLocation location;
+    typename TLogger::TSiteCache *site_cache;
+    long long begin = 0;
 };
 
 }  // namespace Log
 
+/**
+ * @brief Formatter of structured field
+ *
+ * Lets fmt check format strings of calls with `kv` arguments. Field referenced in format string
+ * is printed as "key=value".
+ */
+template <>
+struct fmt::formatter<Log::Field> {
+    constexpr auto parse(fmt::format_parse_context &ctx) { return ctx.begin(); }
+
+    template <typename FormatContext>
+    auto format(const Log::Field &field, FormatContext &ctx) const {
+        std::array<char, 32> num = {};
+        auto number = [&num](auto v) {
+            std::to_chars_result res = std::to_chars(num.data(), num.data() + num.size(), v);
+            return std::string_view(num.data(), static_cast<size_t>(res.ptr - num.data()));
+        };
+
+        std::string_view value;
+        switch (field.type) {
+            case Log::fieldType::Int:
+                value = number(field.value.i);
+                break;
+            case Log::fieldType::Uint:
+                value = number(field.value.u);
+                break;
+            case Log::fieldType::Double:
+                value = number(field.value.d);
+                break;
+            case Log::fieldType::Bool:
+                value = field.value.b ? "true" : "false";
+                break;
+            case Log::fieldType::String:
+                value = {field.value.str.data, field.value.str.size};
+                break;
+            default:
+                break;
+        }
+
+        auto out = ctx.out();
+        for (char ch : field.key) {
+            *out++ = ch;
+        }
+        *out++ = '=';
+        for (char ch : value) {
+            *out++ = ch;
+        }
+        return out;
+    }
+};
+
 #endif
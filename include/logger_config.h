@@ -1,7 +1,9 @@
 #ifndef LOGGERCONFIG_H
 #define LOGGERCONFIG_H
 
+#include <array>
 #include <cstddef>
+#include <string_view>
 
 namespace Log {
 
@@ -13,6 +15,28 @@ enum class level : int {
     DebugMsg = 4,
 };
 
+/// names of logging levels in output message, indexed by `level`
+inline constexpr std::array<std::string_view, 5> msg_log_types = {"FATAL", "ERROR", "WARN",
+                                                                  "INFO", "DEBUG"};
+
+/**
+ * @brief The queuePolicy enum
+ *
+ * What async backend does with a message when producer queue is full
+ */
+enum class queuePolicy : int {
+    /// wait for free slot up to `LOGGER_QUEUE_TIMEOUT_MS`, then drop the message. Caller spins
+    /// with `std::this_thread::yield` while it waits
+    Block = 0,
+    /// drop the message
+    DropNewest = 1,
+    /// drop the oldest message in queue to make room
+    DropOldest = 2,
+    /// place the message in overflow queue shared by all threads, drop if it is full too. Next
+    /// messages of the thread follow it there until it is taken, thread keeps its order
+    Spill = 3,
+};
+
 }  // namespace Log
 
 namespace Log::Config {
@@ -25,6 +49,22 @@ struct BaseTraits {
     static constexpr size_t LOGGER_MAX_MESSAGE_SIZE = 256;
     /// Maximum length of logger input user format specifier
     static constexpr size_t LOGGER_MAX_FORMAT_SIZE = 128;
+    /// Enables placing formatted messages longer than `LOGGER_MAX_FORMAT_SIZE` in per-thread
+    /// arena instead of truncating them. Thread gets its arena from `Logger::prepareThread`
+    static constexpr bool ENABLE_PAYLOAD_SPILL = false;
+    /// Maximum length of message placed in arena, longer messages are truncated
+    static constexpr size_t LOGGER_MAX_PAYLOAD_SIZE = 4096;
+    /// Size of per-thread arena for long messages
+    static constexpr size_t LOGGER_ARENA_SIZE = 64 * 1024;
+    /// Maximum number of blob bytes printed by `logBytes`, the rest is only counted. Every
+    /// stored message and queue slot holds these bytes, their dump is formatted when message is
+    /// rendered and gets room in addition to `LOGGER_MAX_STR_SIZE`
+    static constexpr size_t LOGGER_MAX_DUMP_SIZE = 64;
+    /// Maximum number of structured fields passed with `kv` in one message. Every message and
+    /// queue slot holds room for them, 0 disables `kv`
+    static constexpr size_t LOGGER_MAX_FIELDS = 0;
+    /// Maximum total length of string values of structured fields in one message
+    static constexpr size_t LOGGER_FIELDS_BUFFER_SIZE = 0;
     /// Maximum length of string to place numbers
     static constexpr size_t LOGGER_MAX_NUMBUF_SIZE = 12;
     /// Maximum number of tokens to search in log message pattern
@@ -36,8 +76,45 @@ struct BaseTraits {
     static constexpr bool ENABLE_PRINT_CALLBACK = false;  // callback disabled by default
     /// Enables sinks to print log messages during compile time
     static constexpr bool ENABLE_SINKS = true;  // sinks enabled by default
+    /// Enables caching static part of message ("%{level}", "%{file}", "%{line}"...) for every
+    /// call site, so only dynamic tokens are rendered for each message. Costs about
+    /// `LOGGER_SITE_CACHE_SIZE` bytes of static memory per call site
+    static constexpr bool ENABLE_SITE_CACHE = false;
+    /// Size of static part cache of one call site
+    static constexpr size_t LOGGER_SITE_CACHE_SIZE = 256;
+    /// Enables escaping control characters, DEL and invalid UTF-8 in "%{message}" to prevent
+    /// forged log lines and terminal escape sequences
+    static constexpr bool ENABLE_SANITIZE = false;
+    /// Enables formatting messages with only "{}" fields of integers, floating point numbers,
+    /// bools, strings and pointers without fmt, @see fast_format.h
+    static constexpr bool ENABLE_FAST_FORMAT = true;
+    /// Enables passing log messages to background thread instead of rendering in caller thread
+    static constexpr bool ENABLE_ASYNC = false;  // async disabled by default
+
+    /// Number of messages in each producer thread queue, must be power of two
+    static constexpr size_t LOGGER_QUEUE_SIZE = 256;
+    /// Maximum number of live producer threads with their own queue, ended threads free theirs
+    static constexpr size_t LOGGER_MAX_PRODUCERS = 16;
+    /// Time in microseconds background thread holds message waiting for older messages from
+    /// other threads. Messages are ordered by timestamp within this window
+    static constexpr long LOGGER_REORDER_WINDOW_US = 1000;
+    /// Time in microseconds background thread sleeps when all queues are empty
+    static constexpr long LOGGER_BACKEND_POLL_US = 100;
+    /// Action for full queue per logging level, indexed by `level`. By default only FATAL and
+    /// ERROR messages may block caller, for up to `LOGGER_QUEUE_TIMEOUT_MS` per message
+    static constexpr std::array<queuePolicy, 5> LOGGER_QUEUE_POLICY = {
+        queuePolicy::Block, queuePolicy::Block, queuePolicy::DropNewest, queuePolicy::DropNewest,
+        queuePolicy::DropNewest};
+    /// Time in milliseconds `queuePolicy::Block` waits for free slot
+    static constexpr unsigned long LOGGER_QUEUE_TIMEOUT_MS = 10;
+    /// Number of messages in overflow queue used by `queuePolicy::Spill`, must be power of two
+    static constexpr size_t LOGGER_OVERFLOW_SIZE = 1024;
+    /// Maximum number of named loggers in `Registry`
+    static constexpr size_t LOGGER_REGISTRY_SIZE = 64;
 
     static constexpr int LOGGER_MAX_LEVEL = 4;  // Debug by default
+    /// Level of messages created by `LOG_SCOPE`
+    static constexpr level LOGGER_SPAN_LEVEL = level::DebugMsg;
 
     /// Check logging level during preprocess. Silences logging levels even if setup level in
     /// code is another. Printing log via direct call of log function still can be performed.
@@ -0,0 +1,214 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "async_backend.h"
+#include "logger.h"
+
+namespace Log {
+
+/**
+ * @brief The Registry class
+ *
+ * Named loggers of one application that share context provider, sinks and, with `ENABLE_ASYNC`,
+ * one `AsyncBackend`. Every logger is front-end with its own level, pattern and name printed by
+ * "%{logger}" token. Sinks are copied to every logger, sinks of this library are handles, so all
+ * loggers write to the same files and sockets.
+ *
+ * Loggers are created on first `get` and live as long as registry, returned pointers stay
+ * valid. Lookup of existing logger takes no lock, but it compares names, so keep the pointer
+ * in hot code.
+ * @example if (auto *net = registry.get("net")) { auto &log = *net; Info(log, "connected\n"); }
+ */
+template <typename TLogger>
+class Registry {
+public:
+    using TConfig = typename TLogger::TConfig;
+    using TProvider = typename TLogger::TProvider;
+    using TSinks = typename TLogger::TSinks;
+
+    /// Maximum number of loggers, including root
+    static constexpr size_t capacity = TConfig::LOGGER_REGISTRY_SIZE;
+
+    /**
+     * @brief Registry
+     * @param provider context provider copied to every logger
+     * @param sink_args sinks copied to every logger
+     *
+     * Creates root logger with empty name, it renders messages of all loggers in background
+     * thread when `ENABLE_ASYNC` is set
+     */
+    template <typename... TArgs>
+    explicit Registry(const TProvider &provider, TArgs &&...sink_args)
+        : data_provider_instance(provider),
+          sinks_tuple(std::forward<TArgs>(sink_args)...) {
+        create("");
+        if constexpr (TConfig::ENABLE_ASYNC) {
+            backend = std::make_unique<TBackend>(*entries[0].logger);
+        }
+    }
+
+    Registry(const Registry &) = delete;
+    Registry &operator=(const Registry &) = delete;
+    Registry(Registry &&) = delete;
+    Registry &operator=(Registry &&) = delete;
+
+    ~Registry() {
+        // queued messages are rendered by their loggers
+        backend.reset();
+    }
+
+    /**
+     * @brief root
+     * @return logger with empty name
+     */
+    TLogger &root() const { return *entries[0].logger; }
+
+    /**
+     * @brief find
+     * @param name logger name
+     * @return logger or nullptr if there is no logger with this name
+     */
+    TLogger *find(std::string_view name) const {
+        const size_t count = entries_count.load(std::memory_order_acquire);
+        for (size_t i = 0; i < count; ++i) {
+            if (entries[i].name == name) {
+                return entries[i].logger.get();
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * @brief get
+     * @param name logger name
+     * @return logger with this name, created with default level and pattern if there is none.
+     * nullptr if registry is full
+     */
+    TLogger *get(std::string_view name) {
+        if (TLogger *logger = find(name)) {
+            return logger;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        if (TLogger *logger = find(name)) {
+            return logger;
+        }
+        return create(name);
+    }
+
+    /**
+     * @brief prepareThread
+     * @return false if thread state could not be allocated
+     *
+     * Prepares calling thread for logging with all loggers of registry, call it at thread start,
+     * @see Logger::prepareThread, AsyncBackend::prepareThread
+     */
+    bool prepareThread() {
+        if constexpr (TConfig::ENABLE_ASYNC) {
+            return backend->prepareThread();
+        }
+        return root().prepareThread();
+    }
+
+    /**
+     * @brief setDefaultLogLevel
+     * @param lev level of loggers created after this call
+     */
+    void setDefaultLogLevel(level lev) {
+        std::lock_guard<std::mutex> lock(mutex);
+        default_level = lev;
+    }
+
+    /**
+     * @brief setDefaultLogPattern
+     * @param pattern pattern of loggers created after this call, @see Logger::setLogPattern
+     */
+    void setDefaultLogPattern(const char *pattern) {
+        std::lock_guard<std::mutex> lock(mutex);
+        default_pattern = pattern;
+    }
+
+    /**
+     * @brief forEach
+     * @param func called with every logger, `void(TLogger &)`
+     */
+    template <typename TFunc>
+    void forEach(const TFunc &func) const {
+        const size_t count = entries_count.load(std::memory_order_acquire);
+        for (size_t i = 0; i < count; ++i) {
+            func(*entries[i].logger);
+        }
+    }
+
+    /**
+     * @brief size
+     * @return number of loggers, including root
+     */
+    size_t size() const { return entries_count.load(std::memory_order_acquire); }
+
+private:
+    /// placeholder for backend when `ENABLE_ASYNC` is not set
+    struct NoBackend {
+        void attach([[maybe_unused]] TLogger &logger) {}
+    };
+
+    using TBackend =
+        std::conditional_t<TConfig::ENABLE_ASYNC, AsyncBackend<TLogger>, NoBackend>;
+
+    /// entry is written once before it is published by `entries_count`
+    struct Entry {
+        std::string name;
+        std::unique_ptr<TLogger> logger;
+    };
+
+    /// creates and publishes logger, called under `mutex` or from constructor
+    TLogger *create(std::string_view name) {
+        const size_t count = entries_count.load(std::memory_order_relaxed);
+        if (count == entries.size()) {
+            return nullptr;
+        }
+        Entry &entry = entries[count];
+        entry.name = name;
+        entry.logger = std::apply(
+            [this](const auto &...sinks) {
+                return std::make_unique<TLogger>(data_provider_instance, sinks...);
+            },
+            sinks_tuple);
+        entry.logger->setName(entry.name);
+        entry.logger->setLogLevel(default_level);
+        if (!default_pattern.empty()) {
+            entry.logger->setLogPattern(default_pattern.c_str());
+        }
+        if (backend != nullptr) {
+            backend->attach(*entry.logger);
+        }
+        entries_count.store(count + 1, std::memory_order_release);
+        return entry.logger.get();
+    }
+
+    TProvider data_provider_instance;
+    TSinks sinks_tuple;
+
+    std::array<Entry, capacity> entries;
+    /// number of published entries
+    std::atomic<size_t> entries_count = 0;
+    /// serializes creation of loggers
+    std::mutex mutex;
+    /// the same as default level of `Logger`
+    level default_level = level::InfoMsg;
+    /// empty keeps default pattern of `Logger`
+    std::string default_pattern;
+
+    /// shared background thread, declared last to be destroyed before loggers
+    std::unique_ptr<TBackend> backend;
+};
+
+}  // namespace Log
@@ -0,0 +1,230 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace Log {
+namespace Lz {
+
+/**
+ * LZ4 compatible block compression. Block is a sequence of (literals, match) pairs:
+ * token byte with literal length in the high and match length in the low nibble, extra length
+ * bytes when nibble is 15, literals, 2 bytes little endian offset, extra match length bytes.
+ * The last sequence has literals only. Compressor is greedy with single hash table, it favours
+ * speed over ratio, text logs still shrink several times.
+ */
+
+static constexpr size_t MIN_MATCH = 4;
+/// last bytes of block are always literals
+static constexpr size_t LAST_LITERALS = 5;
+/// match can not start closer to the end of block
+static constexpr size_t MATCH_LIMIT = 12;
+static constexpr size_t MAX_OFFSET = 65535;
+static constexpr unsigned HASH_BITS = 12;
+
+/**
+ * @brief compressBound
+ * @param size size of data to compress
+ * @return worst case size of compressed data
+ */
+constexpr size_t compressBound(size_t size) {
+    return size + size / 255 + 16;
+}
+
+/// little endian load, compilers turn it into single load on little endian targets
+inline uint32_t read32(const unsigned char *data) {
+    return static_cast<uint32_t>(data[0]) | (static_cast<uint32_t>(data[1]) << 8) |
+           (static_cast<uint32_t>(data[2]) << 16) | (static_cast<uint32_t>(data[3]) << 24);
+}
+
+inline uint32_t hash(uint32_t sequence) {
+    return (sequence * 2654435761U) >> (32 - HASH_BITS);
+}
+
+inline unsigned char *writeLength(unsigned char *out, size_t len) {
+    for (; len >= 255; len -= 255) {
+        *out++ = 255;
+    }
+    *out++ = static_cast<unsigned char>(len);
+    return out;
+}
+
+inline unsigned char *writeLiterals(unsigned char *out,
+                                    unsigned char *token,
+                                    const unsigned char *data,
+                                    size_t len) {
+    *token = static_cast<unsigned char>(std::min<size_t>(len, 15) << 4);
+    if (len >= 15) {
+        out = writeLength(out, len - 15);
+    }
+    std::memcpy(out, data, len);
+    return out + len;
+}
+
+/**
+ * @brief compress
+ * @param source data to compress
+ * @param size data size, less than 4 GiB
+ * @param dest buffer for compressed data
+ * @param capacity buffer size, at least `compressBound(size)`
+ * @return size of compressed data, 0 if buffer is too small
+ */
+inline size_t compress(const char *source, size_t size, char *dest, size_t capacity) {
+    if (capacity < compressBound(size)) {
+        return 0;
+    }
+
+    const auto *src = reinterpret_cast<const unsigned char *>(source);
+    const unsigned char *const end = src + size;
+    const unsigned char *anchor = src;
+    auto *out = reinterpret_cast<unsigned char *>(dest);
+
+    if (size > MATCH_LIMIT) {
+        std::array<uint32_t, 1U << HASH_BITS> table = {};
+        const unsigned char *const match_end = end - MATCH_LIMIT;
+        const unsigned char *const copy_end = end - LAST_LITERALS;
+        const unsigned char *ip = src + 1;
+        unsigned misses = 0;
+
+        while (ip < match_end) {
+            const uint32_t sequence = read32(ip);
+            const uint32_t h = hash(sequence);
+            const unsigned char *ref = src + table[h];
+            table[h] = static_cast<uint32_t>(ip - src);
+
+            if (ref >= ip || static_cast<size_t>(ip - ref) > MAX_OFFSET ||
+                read32(ref) != sequence) {
+                // step grows on data without matches
+                ip += 1 + (misses++ >> 6);
+                continue;
+            }
+            misses = 0;
+
+            while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+                --ip;
+                --ref;
+            }
+            const unsigned char *match = ip + MIN_MATCH;
+            const unsigned char *match_ref = ref + MIN_MATCH;
+            while (match < copy_end && *match == *match_ref) {
+                ++match;
+                ++match_ref;
+            }
+
+            unsigned char *token = out++;
+            out = writeLiterals(out, token, anchor, static_cast<size_t>(ip - anchor));
+
+            const auto offset = static_cast<size_t>(ip - ref);
+            *out++ = static_cast<unsigned char>(offset & 0xFF);
+            *out++ = static_cast<unsigned char>(offset >> 8);
+
+            const auto match_len = static_cast<size_t>(match - ip) - MIN_MATCH;
+            *token |= static_cast<unsigned char>(std::min<size_t>(match_len, 15));
+            if (match_len >= 15) {
+                out = writeLength(out, match_len - 15);
+            }
+
+            ip = match;
+            anchor = ip;
+            if (ip < match_end) {
+                table[hash(read32(ip - 2))] = static_cast<uint32_t>(ip - 2 - src);
+            }
+        }
+    }
+
+    unsigned char *token = out++;
+    out = writeLiterals(out, token, anchor, static_cast<size_t>(end - anchor));
+    return static_cast<size_t>(out - reinterpret_cast<unsigned char *>(dest));
+}
+
+inline bool readLength(const unsigned char *&in, const unsigned char *end, size_t &len) {
+    unsigned char byte = 0;
+    do {
+        if (in >= end) {
+            return false;
+        }
+        byte = *in++;
+        len += byte;
+    } while (byte == 255);
+    return true;
+}
+
+/**
+ * @brief decompress
+ * @param source compressed block
+ * @param size size of compressed block
+ * @param dest buffer for decompressed data
+ * @param capacity buffer size
+ * @param written size of decompressed data
+ * @return false if block is malformed or does not fit in buffer
+ *
+ * Checks every length and offset, so it is safe to use on damaged files.
+ */
+inline bool decompress(
+    const char *source, size_t size, char *dest, size_t capacity, size_t &written) {
+    const auto *in = reinterpret_cast<const unsigned char *>(source);
+    const unsigned char *const in_end = in + size;
+    auto *const out_begin = reinterpret_cast<unsigned char *>(dest);
+    unsigned char *out = out_begin;
+    unsigned char *const out_end = out + capacity;
+
+    while (true) {
+        if (in >= in_end) {
+            return false;
+        }
+        const unsigned token = *in++;
+
+        size_t literal_len = token >> 4;
+        if (literal_len == 15 && !readLength(in, in_end, literal_len)) {
+            return false;
+        }
+        if (literal_len > static_cast<size_t>(in_end - in) ||
+            literal_len > static_cast<size_t>(out_end - out)) {
+            return false;
+        }
+        std::memcpy(out, in, literal_len);
+        in += literal_len;
+        out += literal_len;
+        if (in == in_end) {
+            break;
+        }
+
+        if (in_end - in < 2) {
+            return false;
+        }
+        const size_t offset = in[0] | (static_cast<size_t>(in[1]) << 8);
+        in += 2;
+        if (offset == 0 || offset > static_cast<size_t>(out - out_begin)) {
+            return false;
+        }
+
+        size_t match_len = token & 0xF;
+        if (match_len == 15 && !readLength(in, in_end, match_len)) {
+            return false;
+        }
+        match_len += MIN_MATCH;
+        if (match_len > static_cast<size_t>(out_end - out)) {
+            return false;
+        }
+
+        const unsigned char *ref = out - offset;
+        if (offset >= match_len) {
+            std::memcpy(out, ref, match_len);
+        } else {
+            // overlapping match repeats the last `offset` bytes
+            for (size_t i = 0; i < match_len; ++i) {
+                out[i] = ref[i];
+            }
+        }
+        out += match_len;
+    }
+
+    written = static_cast<size_t>(out - out_begin);
+    return true;
+}
+
+}  // namespace Lz
+}  // namespace Log
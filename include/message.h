@@ -1,10 +1,22 @@
 
 #pragma once
 
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <cstdint>
 #include <string_view>
+#include <type_traits>
 
+#include "hex_dump.h"
 #include "logger_config.h"
+#include "source_location.h"
+#include "payload_arena.h"
+
+#if defined(__linux__)
+    #include <sys/syscall.h>
+    #include <unistd.h>
+#endif
 
 namespace Log {
 
@@ -15,10 +27,24 @@ namespace Log {
  */
 struct LogRecord {
 public:
-    level msgType;
+    level msgType = level::DebugMsg;
     std::string_view file;
     std::string_view func;
-    size_t line;
+    size_t line = 0;
+    /// file name or project relative path, @see fileBaseOffset
+    std::string_view file_base;
+    /// function name without return type, parameters and template arguments
+    std::string_view func_short;
+
+    constexpr LogRecord() noexcept = default;
+
+    constexpr LogRecord(const level v_msgType, const SourceLocation &loc) noexcept
+        : msgType(v_msgType),
+          file(loc.file),
+          func(loc.func),
+          line(loc.line),
+          file_base(loc.file_base),
+          func_short(loc.func_short) {}
 
     constexpr LogRecord(const level v_msgType,
                         const std::string_view &v_file,
@@ -27,18 +53,167 @@ public:
         : msgType(v_msgType),
           file(v_file),
           func(v_func),
-          line(v_line) {}
+          line(v_line),
+          file_base(v_file),
+          func_short(v_func) {}
+};
+
+/**
+ * @brief The Span struct
+ *
+ * Time interval measured by `LOG_SCOPE`, in nanoseconds of `IContextProvider::getSpanTime`
+ */
+struct Span {
+    /// span name, string literal or other string that outlives logger
+    std::string_view name;
+    long long begin = 0;
+    long long end = 0;
+    /// id of thread span was measured in, @see currentThreadId
+    uint32_t thread = 0;
+
+    /// false for ordinary message
+    bool valid() const { return name.data() != nullptr; }
+};
+
+/**
+ * @brief currentThreadId
+ * @return id of calling thread: kernel thread id on Linux, sequential number elsewhere. Computed
+ * once per thread
+ */
+inline uint32_t currentThreadId() {
+#if defined(__linux__)
+    thread_local const auto id = static_cast<uint32_t>(syscall(SYS_gettid));
+#else
+    static std::atomic<uint32_t> counter = 0;
+    thread_local const uint32_t id = ++counter;
+#endif
+    return id;
+}
+
+enum class fieldType : unsigned char {
+    Int,
+    Uint,
+    Double,
+    Bool,
+    String,
+};
+
+/**
+ * @brief The Field class
+ *
+ * Typed key/value pair of structured log message, created with `kv`. Key must be string literal.
+ * String value points to user data until message is captured, then it is copied to
+ * `LogMessage::fields_data` and `str` holds offset in this buffer.
+ */
+struct Field {
+    struct StrRef {
+        /// user string, nullptr after message captured it
+        const char *data;
+        /// position of captured string in `LogMessage::fields_data`
+        uint32_t offset;
+        uint32_t size;
+    };
+
+    union Value {
+        long long i;
+        unsigned long long u;
+        double d;
+        bool b;
+        StrRef str;
+    };
+
+    std::string_view key;
+    fieldType type = fieldType::Int;
+    Value value = {0};
+};
+
+/**
+ * @brief kv
+ * @param key field name, string literal
+ * @param value integer, floating point, bool or string value
+ * @return field to pass to logging macros after format arguments
+ * @example Info(logger, "request done", Log::kv("status", 200), Log::kv("path", path));
+ */
+template <size_t N, typename T>
+constexpr Field kv(const char (&key)[N], const T &value) {
+    Field field;
+    field.key = std::string_view(key, N - 1);
+    if constexpr (std::is_same_v<T, bool>) {
+        field.type = fieldType::Bool;
+        field.value.b = value;
+    } else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+        field.type = fieldType::Int;
+        field.value.i = value;
+    } else if constexpr (std::is_integral_v<T>) {
+        field.type = fieldType::Uint;
+        field.value.u = value;
+    } else if constexpr (std::is_floating_point_v<T>) {
+        field.type = fieldType::Double;
+        field.value.d = value;
+    } else {
+        static_assert(std::is_convertible_v<const T &, std::string_view>,
+                      "kv value must be integer, floating point, bool or string");
+        std::string_view sv = value;
+        field.type = fieldType::String;
+        field.value.str = {sv.data(), 0, static_cast<uint32_t>(sv.size())};
+    }
+    return field;
+}
+
+/**
+ * @brief The SiteCache class
+ *
+ * Static part of message pre-rendered for one call site: literals and tokens that depend only on
+ * call site ("%{level}", "%{file}", "%{function}", "%{line}"...). Created by logging macros for
+ * every call site and filled by logger on first use.
+ *
+ * Cache is a sequence lock: `seq` is odd while cache is filled and grows with every fill. Readers
+ * copy it with relaxed atomic loads and use the copy only if `seq` did not change meanwhile.
+ */
+template <typename TConfig = Config::Traits<Config::Default>>
+struct SiteCache {
+    static constexpr bool enabled = TConfig::ENABLE_SITE_CACHE;
+    /// number of 8 byte words of static text
+    static constexpr size_t words = enabled ? (TConfig::LOGGER_SITE_CACHE_SIZE + 7) / 8 : 0;
+
+    static_assert(TConfig::LOGGER_SITE_CACHE_SIZE <= UINT16_MAX,
+                  "LOGGER_SITE_CACHE_SIZE must fit in 16 bits");
+
+    /// sequence number, odd while cache is filled
+    std::atomic<uint64_t> seq = 0;
+    /// id of pattern and level cache is rendered for, 0 if empty
+    std::atomic<uint64_t> pattern = 0;
+    /// true if static part did not fit in cache
+    std::atomic<bool> overflow = false;
+    /// end of static text before every dynamic token and end of the last static text
+    std::array<std::atomic<uint16_t>, enabled ? TConfig::LOGGER_MAX_TOKENS + 1 : 0> ends = {};
+    std::array<std::atomic<uint64_t>, words> data = {};
 };
 
+/**
+ * @brief patternIdOf
+ * @param pattern message pattern
+ * @return id of pattern text, loggers with the same pattern share call site caches
+ */
+inline uint64_t patternIdOf(std::string_view pattern) {
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ULL;
+    for (char ch : pattern) {
+        hash = (hash ^ static_cast<unsigned char>(ch)) * 1099511628211ULL;
+    }
+    // 0 marks empty cache
+    return hash == 0 ? 1 : hash;
+}
+
 /**
  * @brief The LogMessage class
  *
  * Holds log context captured in hot path. Should be used with message interface to process data in
  * background
  */
-template <typename ConfigTag = Config::Traits<Config::Default>>
+template <typename TTraits = Config::Traits<Config::Default>>
 struct LogMessage {
-    using TConfig = Log::Config::Traits<ConfigTag>;
+    using TConfig = TTraits;
 
     LogRecord record;
 
@@ -46,6 +221,133 @@ struct LogMessage {
     size_t user_data_len = 0;
 
     long timestamp = 0;
+
+    /// interval measured by `LOG_SCOPE`, empty for ordinary message
+    Span span;
+
+    /// cache of call site, nullptr if message was not created by logging macro
+    SiteCache<TConfig> *site = nullptr;
+
+    /// logger that captured message, renders it in background thread. nullptr if message was
+    /// not queued by logger
+    const void *source = nullptr;
+
+    /// producer queue and position of message among messages of its thread, keeps messages
+    /// spilled to overflow queue in order with the rest. Set by async backend
+    uint32_t producer = 0;
+    uint32_t sequence = 0;
+
+    /// user message that did not fit in `user_data`, released after rendering
+    const typename PayloadArena<TConfig>::Block *spill = nullptr;
+
+    /// structured fields passed with `kv`
+    std::array<Field, TConfig::LOGGER_MAX_FIELDS> fields = {};
+    size_t fields_count = 0;
+    /// copies of string field values
+    std::array<char, TConfig::LOGGER_FIELDS_BUFFER_SIZE> fields_data = {};
+    size_t fields_data_len = 0;
+
+    /// bytes of blob passed to `logBytes`, hex dump of them follows user message
+    std::array<unsigned char, TConfig::LOGGER_MAX_DUMP_SIZE> dump_data = {};
+    size_t dump_len = 0;
+    /// size of the whole blob, 0 if message has no dump
+    size_t dump_total = 0;
+
+    /**
+     * @brief reset
+     *
+     * Prepares message for new logging call, message text and fields are left empty. Message
+     * buffers are not cleared, so queue slot can be reused without touching them
+     */
+    void reset(level lev,
+               const SourceLocation &loc,
+               long ts,
+               SiteCache<TConfig> *call_site,
+               const Span &call_span = Span()) {
+        record = LogRecord(lev, loc);
+        user_data_len = 0;
+        timestamp = ts;
+        span = call_span;
+        site = call_site;
+        source = nullptr;
+        spill = nullptr;
+        fields_count = 0;
+        fields_data_len = 0;
+        dump_len = 0;
+        dump_total = 0;
+    }
+
+    /**
+     * @brief addField
+     * @param field field to capture
+     *
+     * Stores field in message, string value is copied to `fields_data`. Fields that do not fit
+     * are dropped, string values are truncated.
+     */
+    void addField(const Field &field) {
+        if (fields_count >= fields.size()) {
+            return;
+        }
+        Field &dest = fields[fields_count++];
+        dest = field;
+        if (field.type == fieldType::String) {
+            size_t size = field.value.str.size;
+            if (size > fields_data.size() - fields_data_len) {
+                size = fields_data.size() - fields_data_len;
+            }
+            std::copy_n(field.value.str.data, size, fields_data.data() + fields_data_len);
+            dest.value.str = {nullptr, static_cast<uint32_t>(fields_data_len),
+                              static_cast<uint32_t>(size)};
+            fields_data_len += size;
+        }
+    }
+
+    /**
+     * @brief setDump
+     * @param dump blob to capture, only `dump.size` bytes are copied
+     */
+    void setDump(const HexDump &dump) {
+        dump_len = std::min(dump.size, dump_data.size());
+        std::copy_n(dump.data, dump_len, dump_data.data());
+        dump_total = dump.total;
+    }
+
+    /**
+     * @brief dump
+     * @return captured blob, empty if message has no dump
+     */
+    HexDump dump() const { return HexDump{dump_data.data(), dump_len, dump_total}; }
+
+    /**
+     * @brief text
+     * @return formatted user message, from arena if it was spilled
+     */
+    std::string_view text() const {
+        if (spill != nullptr) {
+            return {spill->data(), spill->len};
+        }
+        return {user_data.data(), user_data_len};
+    }
+
+    /**
+     * @brief releaseSpill
+     *
+     * Returns spilled message to arena. Must be called once, after message is rendered or dropped
+     */
+    void releaseSpill() const {
+        if (spill != nullptr) {
+            PayloadArena<TConfig>::release(spill);
+        }
+    }
+
+    /**
+     * @brief fieldString
+     * @param field captured string field
+     * @return value of string field stored in this message
+     */
+    std::string_view fieldString(const Field &field) const {
+        return {fields_data.data() + field.value.str.offset, field.value.str.size};
+    }
 };
 
 }  // namespace Log
@@ -0,0 +1,427 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cctype>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "logger.h"
+
+namespace Log {
+
+/**
+ * @brief The MetricsSink class
+ *
+ * Counts messages per call site instead of writing them. Logger calls `recordImpl` with call site
+ * and level only, and when all sinks of logger are record sinks the message is not formatted or
+ * rendered at all. Counters live in fixed-size open addressing table, a site takes its slot with
+ * one compare-and-swap on first message and later messages cost one relaxed atomic increment.
+ * Messages of sites that do not fit in table are counted per level as untracked.
+ *
+ * Background thread reports every `report_interval_ms`: it passes summary line with message rate,
+ * level histogram and the busiest sites to `on_summary` and rewrites Prometheus text file. The
+ * thread is started only if one of them is set. The last report is made when the last copy of
+ * sink is destroyed.
+ */
+class MetricsSink : public ILogSink<MetricsSink> {
+public:
+    struct Options {
+        /// number of tracked call sites, rounded up to power of two
+        size_t capacity = 1024;
+        /// time between reports, 0 disables background reports
+        unsigned long report_interval_ms = 10000;
+        /// number of sites listed in summary line
+        size_t top_sites = 5;
+        /// receives summary line of every report
+        std::function<void(std::string_view)> on_summary;
+        /// Prometheus text file rewritten by every report, empty to disable
+        std::string prometheus_path;
+    };
+
+    /**
+     * @brief The SiteStats struct
+     *
+     * Counter of one call site and level
+     */
+    struct SiteStats {
+        std::string_view file;
+        std::string_view function;
+        size_t line = 0;
+        level msgType = level::DebugMsg;
+        uint64_t count = 0;
+        /// messages per second since previous report
+        double rate = 0;
+    };
+
+    /// messages come to `recordImpl`
+    static constexpr bool usesRecords = true;
+
+    MetricsSink()
+        : MetricsSink(Options()) {}
+
+    explicit MetricsSink(const Options &options)
+        : table(std::make_shared<Table>(options)) {}
+
+    void sendImpl([[maybe_unused]] const level msgType,
+                  [[maybe_unused]] const char *data,
+                  [[maybe_unused]] size_t size) const {}
+
+    void recordImpl(const LogRecord &record) const { table->add(record); }
+
+    /**
+     * @brief snapshot
+     * @return sites ordered by count, most frequent first
+     */
+    std::vector<SiteStats> snapshot() const { return table->snapshot(); }
+
+    /**
+     * @brief levels
+     * @return number of messages of every level, indexed by `level`
+     */
+    std::array<uint64_t, 5> levels() const { return table->levels(); }
+
+    /// messages of sites that did not fit in table
+    uint64_t untracked() const { return table->untracked(); }
+
+    /**
+     * @brief report
+     *
+     * Makes report now, starts new rate interval
+     */
+    void report() const { table->report(); }
+
+    /// summary line of the same form as passed to `on_summary`, rates since previous report
+    std::string summary() const { return table->summary(); }
+
+private:
+    class Table {
+    public:
+        /// probes before message is counted as untracked
+        static constexpr size_t max_probes = 64;
+
+        explicit Table(const Options &opts)
+            : options(opts),
+              last_report(std::chrono::steady_clock::now()) {
+            size_t capacity = 1;
+            while (capacity < std::max<size_t>(opts.capacity, 1)) {
+                capacity <<= 1;
+            }
+            slots = std::make_unique<Slot[]>(capacity);
+            mask = capacity - 1;
+            if (options.report_interval_ms != 0 && hasOutput()) {
+                worker = std::thread(&Table::run, this);
+            }
+        }
+
+        Table(const Table &) = delete;
+        Table &operator=(const Table &) = delete;
+
+        ~Table() {
+            if (worker.joinable()) {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    running = false;
+                }
+                stop.notify_one();
+                worker.join();
+            }
+            if (hasOutput()) {
+                report();
+            }
+        }
+
+        void add(const LogRecord &record) {
+            const uint64_t key = siteKey(record);
+            size_t idx = static_cast<size_t>(key) & mask;
+            for (size_t probe = 0; probe < std::min(max_probes, mask + 1); ++probe) {
+                Slot &slot = slots[idx];
+                uint64_t current = slot.key.load(std::memory_order_acquire);
+                if (current == 0 &&
+                    slot.key.compare_exchange_strong(current, key, std::memory_order_acq_rel)) {
+                    slot.record = record;
+                    slot.ready.store(true, std::memory_order_release);
+                    current = key;
+                }
+                if (current == key) {
+                    slot.count.fetch_add(1, std::memory_order_relaxed);
+                    return;
+                }
+                idx = (idx + 1) & mask;
+            }
+            lost[static_cast<size_t>(record.msgType)].fetch_add(1, std::memory_order_relaxed);
+        }
+
+        std::vector<SiteStats> snapshot() {
+            std::lock_guard<std::mutex> lock(mutex);
+            return collect(std::chrono::steady_clock::now(), false);
+        }
+
+        std::array<uint64_t, 5> levels() const {
+            std::array<uint64_t, 5> counts = {};
+            for (size_t i = 0; i <= mask; ++i) {
+                const Slot &slot = slots[i];
+                if (slot.ready.load(std::memory_order_acquire)) {
+                    counts[static_cast<size_t>(slot.record.msgType)] +=
+                        slot.count.load(std::memory_order_relaxed);
+                }
+            }
+            for (size_t i = 0; i < counts.size(); ++i) {
+                counts[i] += lost[i].load(std::memory_order_relaxed);
+            }
+            return counts;
+        }
+
+        uint64_t untracked() const {
+            uint64_t total = 0;
+            for (const auto &count : lost) {
+                total += count.load(std::memory_order_relaxed);
+            }
+            return total;
+        }
+
+        std::string summary() {
+            std::lock_guard<std::mutex> lock(mutex);
+            const auto now = std::chrono::steady_clock::now();
+            return formatSummary(collect(now, false), now);
+        }
+
+        void report() {
+            std::lock_guard<std::mutex> lock(mutex);
+            const auto now = std::chrono::steady_clock::now();
+            const std::vector<SiteStats> sites = collect(now, true);
+            if (options.on_summary) {
+                options.on_summary(formatSummary(sites, now));
+            }
+            if (!options.prometheus_path.empty()) {
+                writePrometheus(sites);
+            }
+            last_total = total(sites);
+            last_report = now;
+        }
+
+    private:
+        struct alignas(64) Slot {
+            /// hash of call site, 0 while slot is free
+            std::atomic<uint64_t> key = 0;
+            std::atomic<uint64_t> count = 0;
+            /// set once `record` is written by thread that took slot
+            std::atomic<bool> ready = false;
+            LogRecord record;
+            /// `count` at previous report, used by reporting thread only
+            uint64_t reported = 0;
+        };
+
+        /// true if reports go anywhere
+        bool hasOutput() const { return options.on_summary || !options.prometheus_path.empty(); }
+
+        static uint64_t siteKey(const LogRecord &record) {
+            // file name literal is the same object for all messages of call site
+            uint64_t h = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(record.file.data()));
+            h ^= ((static_cast<uint64_t>(record.line) << 3) |
+                  static_cast<uint64_t>(record.msgType)) *
+                 0x9E3779B97F4A7C15ULL;
+            // splitmix64 finalizer
+            h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
+            h ^= h >> 31;
+            return h != 0 ? h : 1;
+        }
+
+        static uint64_t total(const std::vector<SiteStats> &sites) {
+            uint64_t sum = 0;
+            for (const SiteStats &site : sites) {
+                sum += site.count;
+            }
+            return sum;
+        }
+
+        /**
+         * @brief collect
+         * @param now time of collection
+         * @param advance start new rate interval with collected counts
+         * @return site counters ordered by count, mutex must be locked
+         */
+        std::vector<SiteStats> collect(std::chrono::steady_clock::time_point now, bool advance) {
+            const double seconds = elapsed(now);
+            std::vector<SiteStats> sites;
+            for (size_t i = 0; i <= mask; ++i) {
+                Slot &slot = slots[i];
+                if (!slot.ready.load(std::memory_order_acquire)) {
+                    continue;
+                }
+                SiteStats stats;
+                stats.file = slot.record.file_base;
+                stats.function = slot.record.func_short;
+                stats.line = slot.record.line;
+                stats.msgType = slot.record.msgType;
+                stats.count = slot.count.load(std::memory_order_relaxed);
+                const auto delta = static_cast<double>(stats.count - slot.reported);
+                stats.rate = seconds > 0 ? delta / seconds : 0;
+                if (advance) {
+                    slot.reported = stats.count;
+                }
+                sites.push_back(stats);
+            }
+
+            // header included in several translation units has several copies of file name
+            auto same_site = [](const SiteStats &a, const SiteStats &b) {
+                return a.line == b.line && a.msgType == b.msgType && a.file == b.file;
+            };
+            std::sort(sites.begin(), sites.end(), [](const SiteStats &a, const SiteStats &b) {
+                if (a.file != b.file) {
+                    return a.file < b.file;
+                }
+                return a.line != b.line ? a.line < b.line : a.msgType < b.msgType;
+            });
+            size_t out = 0;
+            for (size_t i = 0; i < sites.size(); ++i) {
+                if (out != 0 && same_site(sites[out - 1], sites[i])) {
+                    sites[out - 1].count += sites[i].count;
+                    sites[out - 1].rate += sites[i].rate;
+                } else {
+                    sites[out++] = sites[i];
+                }
+            }
+            sites.resize(out);
+
+            std::stable_sort(
+                sites.begin(), sites.end(),
+                [](const SiteStats &a, const SiteStats &b) { return a.count > b.count; });
+            return sites;
+        }
+
+        double elapsed(std::chrono::steady_clock::time_point now) const {
+            return std::chrono::duration<double>(now - last_report).count();
+        }
+
+        /// mutex must be locked
+        std::string formatSummary(const std::vector<SiteStats> &sites,
+                                  std::chrono::steady_clock::time_point now) const {
+            const std::array<uint64_t, 5> counts = levels();
+            const uint64_t sum = total(sites);
+            const double seconds = elapsed(now);
+
+            std::string text;
+            auto out = std::back_inserter(text);
+            fmt::format_to(out, "log metrics: {:.1f} msg/s,",
+                           seconds > 0 ? static_cast<double>(sum - last_total) / seconds : 0.0);
+            for (size_t i = 0; i < counts.size(); ++i) {
+                fmt::format_to(out, " {} {}", msg_log_types[i], counts[i]);
+            }
+            fmt::format_to(out, ", untracked {}", untracked());
+            const size_t top = std::min(options.top_sites, sites.size());
+            for (size_t i = 0; i < top; ++i) {
+                const SiteStats &site = sites[i];
+                fmt::format_to(out, "{} {}:{} {} {:.1f}/s", i == 0 ? ", top:" : ",", site.file,
+                               site.line, msg_log_types[static_cast<size_t>(site.msgType)],
+                               site.rate);
+            }
+            return text;
+        }
+
+        /// writes file next to target and renames it, so readers never see partial file
+        void writePrometheus(const std::vector<SiteStats> &sites) const {
+            std::string text;
+            auto out = std::back_inserter(text);
+            text +=
+                "# HELP cpplog_messages_total Messages logged per call site.\n"
+                "# TYPE cpplog_messages_total counter\n";
+            for (const SiteStats &site : sites) {
+                text += "cpplog_messages_total{file=\"";
+                appendLabel(text, site.file);
+                text += "\",function=\"";
+                appendLabel(text, site.function);
+                fmt::format_to(out, "\",line=\"{}\",level=\"", site.line);
+                appendLevel(text, site.msgType);
+                fmt::format_to(out, "\"}} {}\n", site.count);
+            }
+
+            const std::array<uint64_t, 5> counts = levels();
+            text +=
+                "# HELP cpplog_level_messages_total Messages logged per level.\n"
+                "# TYPE cpplog_level_messages_total counter\n";
+            for (size_t i = 0; i < counts.size(); ++i) {
+                text += "cpplog_level_messages_total{level=\"";
+                appendLevel(text, static_cast<level>(i));
+                fmt::format_to(out, "\"}} {}\n", counts[i]);
+            }
+            text +=
+                "# HELP cpplog_untracked_messages_total Messages of sites not fitting in table.\n"
+                "# TYPE cpplog_untracked_messages_total counter\n";
+            fmt::format_to(out, "cpplog_untracked_messages_total {}\n", untracked());
+
+            const std::string tmp = options.prometheus_path + ".tmp";
+            std::FILE *file = std::fopen(tmp.c_str(), "wb");
+            if (file == nullptr) {
+                return;
+            }
+            const bool written = std::fwrite(text.data(), 1, text.size(), file) == text.size();
+            if (std::fclose(file) == 0 && written) {
+                std::rename(tmp.c_str(), options.prometheus_path.c_str());
+            } else {
+                std::remove(tmp.c_str());
+            }
+        }
+
+        /// label value escaping of Prometheus text format
+        static void appendLabel(std::string &text, std::string_view value) {
+            for (char ch : value) {
+                if (ch == '\\' || ch == '"') {
+                    text += '\\';
+                    text += ch;
+                } else if (ch == '\n') {
+                    text += "\\n";
+                } else {
+                    text += ch;
+                }
+            }
+        }
+
+        /// level name in lower case as Prometheus labels are
+        static void appendLevel(std::string &text, level msgType) {
+            for (char ch : msg_log_types[static_cast<size_t>(msgType)]) {
+                text += static_cast<char>(std::tolower(static_cast<unsigned char>(ch)));
+            }
+        }
+
+        void run() {
+            const auto interval = std::chrono::milliseconds(options.report_interval_ms);
+            std::unique_lock<std::mutex> lock(mutex);
+            while (!stop.wait_for(lock, interval, [this] { return !running; })) {
+                lock.unlock();
+                report();
+                lock.lock();
+            }
+        }
+
+        const Options options;
+        std::unique_ptr<Slot[]> slots;
+        size_t mask = 0;
+        /// messages of sites that did not fit, indexed by `level`
+        std::array<std::atomic<uint64_t>, 5> lost = {};
+
+        /// serializes reports, guards fields below
+        mutable std::mutex mutex;
+        std::condition_variable stop;
+        bool running = true;
+        std::chrono::steady_clock::time_point last_report;
+        uint64_t last_total = 0;
+        std::thread worker;
+    };
+
+    std::shared_ptr<Table> table;
+};
+
+}  // namespace Log
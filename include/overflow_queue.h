@@ -0,0 +1,119 @@
+#pragma once
+
+#include <atomic>
+#include <array>
+
+#include "spsc_queue.h"
+
+namespace Log {
+
+/**
+ * @brief The OverflowQueue class
+ *
+ * Bounded lock-free queue shared by all producer threads. Holds messages that did not fit in
+ * producer own queue when `queuePolicy::Spill` is used. Any number of producers and consumers.
+ */
+template <typename TConfig = Config::Traits<Config::Default>>
+class OverflowQueue : public IMessageQueue<OverflowQueue<TConfig>, TConfig> {
+public:
+    using TMessage = LogMessage<TConfig>;
+
+    static_assert((TConfig::LOGGER_OVERFLOW_SIZE & (TConfig::LOGGER_OVERFLOW_SIZE - 1)) == 0,
+                  "LOGGER_OVERFLOW_SIZE must be power of two");
+
+    OverflowQueue() {
+        for (size_t i = 0; i < slots.size(); ++i) {
+            slots[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    OverflowQueue(const OverflowQueue &) = delete;
+    OverflowQueue &operator=(const OverflowQueue &) = delete;
+
+    bool enqueueImpl(const TMessage &msg) {
+        size_t tail = tail_idx.load(std::memory_order_relaxed);
+        while (true) {
+            Slot &slot = slots[tail & mask];
+            size_t seq = slot.seq.load(std::memory_order_acquire);
+            if (seq == tail) {
+                if (tail_idx.compare_exchange_weak(tail, tail + 1, std::memory_order_relaxed)) {
+                    slot.msg = msg;
+                    slot.seq.store(tail + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (seq < tail) {
+                return false;  // full
+            } else {
+                tail = tail_idx.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool enqueueBlockingImpl(const TMessage &msg, unsigned long timeout_ms) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        while (!enqueueImpl(msg)) {
+            if (timeout_ms != 0 && std::chrono::steady_clock::now() >= deadline) {
+                return false;
+            }
+            std::this_thread::yield();
+        }
+        return true;
+    }
+
+    bool dequeueImpl(TMessage &msg) {
+        size_t head = head_idx.load(std::memory_order_relaxed);
+        while (true) {
+            Slot &slot = slots[head & mask];
+            size_t seq = slot.seq.load(std::memory_order_acquire);
+            if (seq == head + 1) {
+                if (head_idx.compare_exchange_weak(head, head + 1, std::memory_order_relaxed)) {
+                    msg = slot.msg;
+                    slot.seq.store(head + TConfig::LOGGER_OVERFLOW_SIZE,
+                                   std::memory_order_release);
+                    return true;
+                }
+            } else if (seq < head + 1) {
+                return false;  // empty
+            } else {
+                head = head_idx.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool dequeueBlockingImpl(TMessage &msg, unsigned long timeout_ms) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        while (!dequeueImpl(msg)) {
+            if (timeout_ms != 0 && std::chrono::steady_clock::now() >= deadline) {
+                return false;
+            }
+            std::this_thread::yield();
+        }
+        return true;
+    }
+
+    /**
+     * @brief position
+     * @return number of messages taken from queue so far
+     */
+    size_t position() const { return head_idx.load(std::memory_order_acquire); }
+
+    /**
+     * @brief published
+     * @return number of slots taken by producers so far, some of them may be still written
+     */
+    size_t published() const { return tail_idx.load(std::memory_order_relaxed); }
+
+private:
+    struct Slot {
+        std::atomic<size_t> seq;
+        TMessage msg;
+    };
+
+    static constexpr size_t mask = TConfig::LOGGER_OVERFLOW_SIZE - 1;
+
+    alignas(LOGGER_CACHE_LINE_SIZE) std::atomic<size_t> tail_idx = 0;
+    alignas(LOGGER_CACHE_LINE_SIZE) std::atomic<size_t> head_idx = 0;
+    alignas(LOGGER_CACHE_LINE_SIZE) std::array<Slot, TConfig::LOGGER_OVERFLOW_SIZE> slots;
+};
+
+}  // namespace Log
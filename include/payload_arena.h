@@ -0,0 +1,223 @@
+#pragma once
+
+#include <atomic>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+#include "logger_config.h"
+
+namespace Log {
+
+/**
+ * @brief The PayloadArena class
+ *
+ * Per-thread ring buffer for user messages longer than `LogMessage::user_data`. Only owner thread
+ * allocates, blocks are released by thread that rendered the message, in any order. Owner thread
+ * reclaims space from the oldest block up to the first block that is still in use, so memory is
+ * bounded by `LOGGER_ARENA_SIZE`. Arena itself is allocated by `attach`, which thread calls once
+ * before logging, so logging calls never allocate. It is freed when the thread is gone and all its
+ * blocks are released.
+ */
+template <typename TConfig = Config::Traits<Config::Default>>
+class PayloadArena {
+public:
+    /**
+     * @brief The Block class
+     *
+     * Header placed before every spilled message
+     */
+    struct Block {
+        PayloadArena *arena;
+        /// size of block with header and padding
+        uint32_t size;
+        /// length of message
+        uint32_t len;
+        std::atomic<bool> released;
+
+        char *data() { return reinterpret_cast<char *>(this + 1); }
+
+        const char *data() const { return reinterpret_cast<const char *>(this + 1); }
+    };
+
+    PayloadArena(const PayloadArena &) = delete;
+    PayloadArena &operator=(const PayloadArena &) = delete;
+
+    /**
+     * @brief attach
+     * @return false if arena could not be allocated
+     *
+     * Allocates arena of calling thread, does nothing if thread has one. Allocates memory and
+     * registers thread exit handler, call it at thread start.
+     */
+    static bool attach() {
+        struct Owner {
+            PayloadArena *arena = nullptr;
+
+            ~Owner() {
+                if (arena != nullptr) {
+                    current() = nullptr;
+                    arena->unref();
+                }
+            }
+        };
+        static thread_local Owner owner;
+
+        if (owner.arena == nullptr) {
+            owner.arena = new (std::nothrow) PayloadArena();
+            current() = owner.arena;
+        }
+        return owner.arena != nullptr;
+    }
+
+    /**
+     * @brief local
+     * @return arena of calling thread, nullptr if thread did not `attach` one
+     */
+    static PayloadArena *local() { return current(); }
+
+    /**
+     * @brief allocate
+     * @param len message length
+     * @return block for message or nullptr if arena has no space. Owner thread only
+     */
+    Block *allocate(size_t len) {
+        reclaim();
+
+        const size_t size = alignUp(sizeof(Block) + len);
+        if (size > buffer.size()) {
+            return nullptr;
+        }
+        if (used == 0) {
+            head = 0;
+            tail = 0;
+        }
+
+        if (tail >= head && used != buffer.size()) {
+            // free space is [tail, end) and [0, head)
+            if (buffer.size() - tail < size) {
+                if (head < size) {
+                    return nullptr;
+                }
+                // rest of buffer is skipped with released padding block
+                if (buffer.size() - tail >= sizeof(Block)) {
+                    Block *pad = place(tail, buffer.size() - tail, 0);
+                    pad->released.store(true, std::memory_order_relaxed);
+                }
+                used += buffer.size() - tail;
+                tail = 0;
+            }
+        } else if (head - tail < size) {
+            return nullptr;
+        }
+
+        Block *block = place(tail, size, len);
+        tail += size;
+        used += size;
+        refs.fetch_add(1, std::memory_order_relaxed);
+        return block;
+    }
+
+    /**
+     * @brief shrink
+     * @param block the last block returned by `allocate`, not passed to other threads yet
+     * @param len new message length, not greater than current one
+     *
+     * Returns unused end of block to arena. Owner thread only
+     */
+    void shrink(Block *block, size_t len) {
+        const size_t size = alignUp(sizeof(Block) + len);
+        tail -= block->size - size;
+        used -= block->size - size;
+        block->size = static_cast<uint32_t>(size);
+        block->len = static_cast<uint32_t>(len);
+    }
+
+    /**
+     * @brief cancel
+     * @param block the last block returned by `allocate`, not passed to other threads yet
+     *
+     * Returns whole block to arena. Owner thread only
+     */
+    void cancel(Block *block) {
+        tail -= block->size;
+        used -= block->size;
+        refs.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief release
+     * @param block block returned by `allocate`, may be called from any thread
+     */
+    static void release(const Block *block) {
+        PayloadArena *arena = block->arena;
+        const_cast<Block *>(block)->released.store(true, std::memory_order_release);
+        arena->unref();
+    }
+
+private:
+    PayloadArena() = default;
+
+    /// arena of calling thread, trivial thread local is read without thread exit registration
+    static PayloadArena *&current() {
+        static thread_local PayloadArena *arena = nullptr;
+        return arena;
+    }
+
+    static constexpr size_t alignUp(size_t size) {
+        return (size + alignof(Block) - 1) & ~(alignof(Block) - 1);
+    }
+
+    Block *place(size_t offset, size_t size, size_t len) {
+        auto *block = new (buffer.data() + offset) Block;
+        block->arena = this;
+        block->size = static_cast<uint32_t>(size);
+        block->len = static_cast<uint32_t>(len);
+        block->released.store(false, std::memory_order_relaxed);
+        return block;
+    }
+
+    /**
+     * @brief reclaim
+     *
+     * Frees released blocks starting from the oldest one. Owner thread only
+     */
+    void reclaim() {
+        while (used != 0) {
+            if (buffer.size() - head < sizeof(Block)) {
+                // tail end too small for header, allocation wrapped without padding block
+                used -= buffer.size() - head;
+                head = 0;
+                continue;
+            }
+            auto *block = reinterpret_cast<Block *>(buffer.data() + head);
+            if (!block->released.load(std::memory_order_acquire)) {
+                break;
+            }
+            head += block->size;
+            used -= block->size;
+            if (head == buffer.size()) {
+                head = 0;
+            }
+        }
+    }
+
+    void unref() {
+        if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            delete this;
+        }
+    }
+
+    alignas(Block) std::array<unsigned char, TConfig::LOGGER_ARENA_SIZE> buffer;
+    /// offset of the oldest block in use
+    size_t head = 0;
+    /// offset of the next block
+    size_t tail = 0;
+    /// bytes taken by blocks and padding
+    size_t used = 0;
+    /// owner thread and every allocated block hold one reference
+    std::atomic<size_t> refs = 1;
+};
+
+}  // namespace Log
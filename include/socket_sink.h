@@ -0,0 +1,489 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "logger.h"
+
+namespace Log {
+
+/**
+ * @brief The UnixSocketSink class
+ *
+ * Sends rendered messages to local log collector over `AF_UNIX` stream or datagram socket.
+ * Logging thread only copies message to bounded ring buffer, it never waits for socket. Background
+ * thread sends everything collected since the last send at once: stream socket gets one `sendmsg`
+ * with up to `IOV_MAX` messages, datagram socket gets one `sendmmsg` (Linux) with one datagram
+ * per message.
+ *
+ * While collector is down messages stay in buffer and connection is retried every
+ * `reconnect_interval_ms`. When buffer is full new messages are dropped and counted, once there
+ * is space again the count is placed in buffer as "N messages dropped" line after messages that
+ * were already there. Stream message sent in part is continued on the same connection, message
+ * interrupted by broken connection is sent again whole after reconnect.
+ *
+ * Sink is a handle, copies share the same socket. Buffered messages are sent, if collector is
+ * up, when the last copy is destroyed.
+ */
+class UnixSocketSink : public ILogSink<UnixSocketSink> {
+public:
+    enum class socketType { Stream, Datagram };
+
+    struct Options {
+        socketType type = socketType::Stream;
+        /// size of ring buffer holding messages until they are sent
+        size_t buffer_size = 1024 * 1024;
+        /// time between connection attempts while collector is down
+        unsigned long reconnect_interval_ms = 500;
+        /// time to wait for collector to receive buffered messages on destruction
+        unsigned long close_timeout_ms = 1000;
+    };
+
+    /// messages are rendered directly in ring buffer
+    static constexpr bool supportsReserve = true;
+
+    explicit UnixSocketSink(const std::string &path)
+        : UnixSocketSink(path, Options()) {}
+
+    UnixSocketSink(const std::string &path, const Options &options)
+        : sender(std::make_shared<Sender>(path, options)) {}
+
+    void sendImpl([[maybe_unused]] const level msgType, const char *data, size_t size) const {
+        char *buf = sender->reserve(size);
+        if (buf == nullptr) {
+            sender->countDropped();
+            return;
+        }
+        std::memcpy(buf, data, size);
+        sender->commit(size);
+    }
+
+    char *reserveImpl(size_t size) const { return sender->reserve(size); }
+
+    void commitImpl([[maybe_unused]] const level msgType,
+                    [[maybe_unused]] char *data,
+                    size_t size) const {
+        sender->commit(size);
+    }
+
+    /**
+     * @brief dropped
+     * @return number of messages dropped because buffer was full
+     */
+    size_t dropped() const { return sender->dropped(); }
+
+    /**
+     * @brief connected
+     * @return true if collector is connected now
+     */
+    bool connected() const { return sender->connected(); }
+
+private:
+    class Sender {
+    public:
+        Sender(const std::string &socket_path, const Options &opts)
+            : path(socket_path),
+              options(opts),
+              ring(alignUp(opts.buffer_size)) {
+            worker = std::thread(&Sender::run, this);
+        }
+
+        Sender(const Sender &) = delete;
+        Sender &operator=(const Sender &) = delete;
+
+        ~Sender() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                running = false;
+            }
+            work_ready.notify_one();
+            worker.join();
+            disconnect();
+        }
+
+        /**
+         * @brief reserve
+         * @return place for message of `size` bytes in ring buffer, mutex stays locked until
+         * `commit`. nullptr if buffer is full
+         */
+        char *reserve(size_t size) {
+            const size_t need = alignUp(header_size + size);
+            mutex.lock();
+            queueDropped();
+            if (need > ring.size() || !makeRoom(need)) {
+                mutex.unlock();
+                return nullptr;
+            }
+            return ring.data() + tail + header_size;
+        }
+
+        void commit(size_t size) {
+            push(size);
+            mutex.unlock();
+            work_ready.notify_one();
+        }
+
+        void countDropped() { dropped_total.fetch_add(1, std::memory_order_relaxed); }
+
+        size_t dropped() const { return dropped_total.load(std::memory_order_relaxed); }
+
+        bool connected() const { return is_connected.load(std::memory_order_relaxed); }
+
+    private:
+        /// message in ring is length followed by data, both aligned to `header_size`
+        static constexpr size_t header_size = sizeof(uint32_t);
+        /// length of header that tells reader to continue from the start of ring
+        static constexpr uint32_t wrap_marker = UINT32_MAX;
+        /// messages taken by one send
+        static constexpr size_t max_batch = 1024;
+
+        static constexpr size_t alignUp(size_t size) {
+            return (size + header_size - 1) & ~(header_size - 1);
+        }
+
+        void writeHeader(size_t pos, uint32_t len) {
+            std::memcpy(ring.data() + pos, &len, sizeof(len));
+        }
+
+        uint32_t readHeader(size_t pos) const {
+            uint32_t len = 0;
+            std::memcpy(&len, ring.data() + pos, sizeof(len));
+            return len;
+        }
+
+        /**
+         * @brief makeRoom
+         * @return true if `need` bytes are free at `tail`, mutex must be locked
+         *
+         * Skips end of ring that is too small with wrap marker
+         */
+        bool makeRoom(size_t need) {
+            if (used == 0) {
+                head = 0;
+                tail = 0;
+            }
+            if (tail >= head && used != ring.size()) {
+                // free space is [tail, end) and [0, head)
+                if (ring.size() - tail >= need) {
+                    return true;
+                }
+                if (head < need) {
+                    return false;
+                }
+                writeHeader(tail, wrap_marker);
+                used += ring.size() - tail;
+                tail = 0;
+                return true;
+            }
+            return head - tail >= need;
+        }
+
+        /// passes message of `size` bytes placed at `tail` to background thread, mutex must be
+        /// locked
+        void push(size_t size) {
+            writeHeader(tail, static_cast<uint32_t>(size));
+            const size_t need = alignUp(header_size + size);
+            tail += need;
+            used += need;
+            if (tail == ring.size()) {
+                tail = 0;
+            }
+        }
+
+        /**
+         * @brief queueDropped
+         *
+         * Places "N messages dropped" line in ring if messages were dropped since the last one,
+         * so it is sent after older messages. Mutex must be locked
+         */
+        void queueDropped() {
+            const size_t total = dropped_total.load(std::memory_order_relaxed);
+            if (total == dropped_queued) {
+                return;
+            }
+            std::array<char, 64> line;
+            auto res = fmt::format_to_n(line.data(), line.size(), "{:d} messages dropped\n",
+                                        total - dropped_queued);
+            const size_t size = std::min(res.size, line.size());
+            if (!makeRoom(alignUp(header_size + size))) {
+                return;
+            }
+            std::memcpy(ring.data() + tail + header_size, line.data(), size);
+            push(size);
+            dropped_queued = total;
+        }
+
+        /**
+         * @brief collect
+         *
+         * Fills `batch` with messages from the oldest one and `batch_ends` with ring bytes taken
+         * by messages up to every one of them. Mutex must be locked
+         */
+        void collect() {
+            batch.clear();
+            batch_ends.clear();
+            size_t pos = head;
+            size_t taken = 0;
+            while (taken < used && batch.size() < max_batch) {
+                uint32_t len = readHeader(pos);
+                if (len == wrap_marker) {
+                    taken += ring.size() - pos;
+                    pos = 0;
+                    continue;
+                }
+                batch.push_back({ring.data() + pos + header_size, len});
+                const size_t size = alignUp(header_size + len);
+                taken += size;
+                pos += size;
+                if (pos == ring.size()) {
+                    pos = 0;
+                }
+                batch_ends.push_back(taken);
+            }
+        }
+
+        /// frees ring bytes of messages that were sent, mutex must be locked
+        void release(size_t bytes) {
+            used -= bytes;
+            head = (head + bytes) % ring.size();
+        }
+
+        void run() {
+            const auto retry = std::chrono::milliseconds(options.reconnect_interval_ms);
+            auto has_work = [this] { return used != 0 || !running; };
+            auto close_deadline = std::chrono::steady_clock::time_point::max();
+            std::unique_lock<std::mutex> lock(mutex);
+
+            while (true) {
+                if (!running) {
+                    if (close_deadline == std::chrono::steady_clock::time_point::max()) {
+                        close_deadline = std::chrono::steady_clock::now() +
+                                         std::chrono::milliseconds(options.close_timeout_ms);
+                    }
+                    if (used == 0 || std::chrono::steady_clock::now() >= close_deadline) {
+                        break;
+                    }
+                } else {
+                    work_ready.wait(lock, has_work);
+                }
+
+                if (fd < 0) {
+                    lock.unlock();
+                    if (!connect()) {
+                        std::this_thread::sleep_for(retry);
+                    }
+                    lock.lock();
+                    continue;
+                }
+
+                collect();
+                lock.unlock();
+
+                const size_t sent = options.type == socketType::Stream ? sendStream()
+                                                                        : sendDatagrams();
+
+                lock.lock();
+                if (sent != 0) {
+                    release(batch_ends[sent - 1]);
+                }
+                // messages dropped by background thread or while ring stayed full
+                queueDropped();
+                if (sent != batch.size()) {
+                    // collector is slow or gone, do not spin
+                    lock.unlock();
+                    std::this_thread::sleep_for(fd < 0 ? retry : std::chrono::milliseconds(1));
+                    lock.lock();
+                }
+            }
+        }
+
+        bool connect() {
+            const int type = options.type == socketType::Stream ? SOCK_STREAM : SOCK_DGRAM;
+#if defined(SOCK_CLOEXEC)
+            int sock = ::socket(AF_UNIX, type | SOCK_CLOEXEC, 0);
+#else
+            int sock = ::socket(AF_UNIX, type, 0);
+#endif
+            if (sock < 0) {
+                return false;
+            }
+            // stalled collector must not block shutdown
+            timeval timeout = {0, 100 * 1000};
+            setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+            sockaddr_un addr = {};
+            addr.sun_family = AF_UNIX;
+            std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+            if (::connect(sock, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) != 0) {
+                ::close(sock);
+                return false;
+            }
+            fd = sock;
+            is_connected.store(true, std::memory_order_relaxed);
+            return true;
+        }
+
+        void disconnect() {
+            if (fd >= 0) {
+                ::close(fd);
+                fd = -1;
+            }
+            is_connected.store(false, std::memory_order_relaxed);
+        }
+
+        static int sendFlags() {
+#if defined(MSG_NOSIGNAL)
+            return MSG_NOSIGNAL;
+#else
+            return 0;
+#endif
+        }
+
+        /// true if error means collector is gone
+        static bool isDisconnect(int err) {
+            return err != EAGAIN && err != EWOULDBLOCK && err != EINTR && err != ENOBUFS;
+        }
+
+        /**
+         * @brief sendStream
+         * @return number of messages sent whole
+         *
+         * Bytes sent of the first message that was not sent whole are kept in `resume_offset`,
+         * the next send continues it
+         */
+        size_t sendStream() {
+            size_t first = 0;
+            size_t offset = resume_offset;
+            while (first < batch.size()) {
+                iov.clear();
+                for (size_t i = first; i < batch.size() && iov.size() < IOV_MAX; ++i) {
+                    iov.push_back(batch[i]);
+                }
+                iov[0].iov_base = static_cast<char *>(iov[0].iov_base) + offset;
+                iov[0].iov_len -= offset;
+
+                msghdr msg = {};
+                msg.msg_iov = iov.data();
+                msg.msg_iovlen = iov.size();
+                ssize_t res = ::sendmsg(fd, &msg, sendFlags());
+                if (res < 0) {
+                    if (isDisconnect(errno)) {
+                        // new connection gets the message whole
+                        disconnect();
+                        offset = 0;
+                    }
+                    break;
+                }
+
+                auto left = static_cast<size_t>(res) + offset;
+                offset = 0;
+                while (first < batch.size() && left >= batch[first].iov_len) {
+                    left -= batch[first].iov_len;
+                    ++first;
+                }
+                offset = left;
+            }
+            resume_offset = offset;
+            return first;
+        }
+
+        /**
+         * @brief sendDatagrams
+         * @return number of messages sent
+         */
+        size_t sendDatagrams() {
+            size_t first = 0;
+#if defined(__linux__)
+            headers.resize(batch.size());
+            for (size_t i = 0; i < batch.size(); ++i) {
+                headers[i] = {};
+                headers[i].msg_hdr.msg_iov = &batch[i];
+                headers[i].msg_hdr.msg_iovlen = 1;
+            }
+            while (first < batch.size()) {
+                int res = ::sendmmsg(fd, headers.data() + first,
+                                   static_cast<unsigned>(batch.size() - first), sendFlags());
+                if (res < 0 && errno == EMSGSIZE) {
+                    // message does not fit in datagram, it would block all others
+                    countDropped();
+                    ++first;
+                    continue;
+                }
+                if (res <= 0) {
+                    if (res < 0 && isDisconnect(errno)) {
+                        disconnect();
+                    }
+                    break;
+                }
+                first += static_cast<size_t>(res);
+            }
+#else
+            for (; first < batch.size(); ++first) {
+                if (::send(fd, batch[first].iov_base, batch[first].iov_len, sendFlags()) < 0) {
+                    if (errno == EMSGSIZE) {
+                        countDropped();
+                        continue;
+                    }
+                    if (isDisconnect(errno)) {
+                        disconnect();
+                    }
+                    break;
+                }
+            }
+#endif
+            return first;
+        }
+
+        const std::string path;
+        const Options options;
+
+        std::mutex mutex;
+        /// signals background thread that there are messages or sink stops
+        std::condition_variable work_ready;
+        std::vector<char> ring;
+        /// offset of the oldest message
+        size_t head = 0;
+        /// offset of the next message
+        size_t tail = 0;
+        /// bytes taken by messages and wrap markers
+        size_t used = 0;
+        /// dropped messages counted in lines placed in ring
+        size_t dropped_queued = 0;
+        bool running = true;
+
+        std::atomic<size_t> dropped_total = 0;
+        std::atomic<bool> is_connected = false;
+
+        /// used by background thread only
+        int fd = -1;
+        /// bytes of the oldest message already sent to stream
+        size_t resume_offset = 0;
+        std::vector<iovec> batch;
+        std::vector<size_t> batch_ends;
+        std::vector<iovec> iov;
+#if defined(__linux__)
+        std::vector<mmsghdr> headers;
+#endif
+        std::thread worker;
+    };
+
+    std::shared_ptr<Sender> sender;
+};
+
+}  // namespace Log
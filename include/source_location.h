@@ -0,0 +1,161 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+namespace Log {
+
+/**
+ * @brief fileBaseOffset
+ * @param path source file path, usually `__FILE__`
+ * @return position of project relative path if `LOG_SOURCE_ROOT` is defined and is prefix of
+ * `path`, position of file name otherwise
+ */
+constexpr size_t fileBaseOffset(std::string_view path) {
+#if defined(LOG_SOURCE_ROOT)
+    constexpr std::string_view root = LOG_SOURCE_ROOT;
+    if (path.substr(0, root.size()) == root) {
+        return root.size();
+    }
+#endif
+    size_t slash = path.find_last_of("/\\");
+    return slash == std::string_view::npos ? 0 : slash + 1;
+}
+
+/**
+ * @brief The FuncRange class
+ *
+ * Position of short function name inside function signature
+ */
+struct FuncRange {
+    size_t begin;
+    size_t end;
+};
+
+constexpr bool isIdentifierChar(char ch) {
+    return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || (ch >= '0' && ch <= '9') ||
+           ch == '_';
+}
+
+constexpr bool isOperatorChar(char ch) {
+    return std::string_view("<>=!+-*/%&|^~[],").find(ch) != std::string_view::npos;
+}
+
+constexpr bool endsWith(std::string_view str, std::string_view suffix) {
+    return str.size() >= suffix.size() && str.substr(str.size() - suffix.size()) == suffix;
+}
+
+/**
+ * @brief endsWithOperator
+ * @return true if name ends with operator symbol like "operator>>"
+ */
+constexpr bool endsWithOperator(std::string_view name) {
+    size_t i = name.size();
+    while (i > 0 && isOperatorChar(name[i - 1])) {
+        --i;
+    }
+    return i < name.size() && endsWith(name.substr(0, i), "operator");
+}
+
+/**
+ * @brief funcShortRange
+ * @param sig function signature, usually `__PRETTY_FUNCTION__` or `__FUNCSIG__`
+ * @return range of qualified function name without return type, parameters and template
+ * arguments of the function itself
+ * @example "std::pair<int, int> ns::Foo<T>::bar<U>(int) [with T = int]" -> "ns::Foo<T>::bar"
+ */
+constexpr FuncRange funcShortRange(std::string_view sig) {
+    constexpr std::string_view op = "operator";
+    constexpr std::string_view anonymous = "(anonymous namespace)";
+
+    // end of name is the first '(' outside of template arguments
+    size_t end = sig.size();
+    int angle = 0;
+    for (size_t i = 0; i < sig.size(); ++i) {
+        if (sig.substr(i, op.size()) == op && (i == 0 || !isIdentifierChar(sig[i - 1]))) {
+            i += op.size();
+            if (sig.substr(i, 2) == "()") {
+                ++i;
+                continue;
+            }
+            while (i < sig.size() && isOperatorChar(sig[i])) {
+                ++i;
+            }
+            --i;
+            continue;
+        }
+        if (sig.substr(i, anonymous.size()) == anonymous) {
+            i += anonymous.size() - 1;
+            continue;
+        }
+        char ch = sig[i];
+        if (ch == '<') {
+            ++angle;
+        } else if (ch == '>' && angle > 0) {
+            --angle;
+        } else if (ch == '(' && angle == 0) {
+            end = i;
+            break;
+        }
+    }
+
+    // drop template arguments of the function itself
+    if (end > 0 && sig[end - 1] == '>' && !endsWithOperator(sig.substr(0, end))) {
+        int depth = 0;
+        for (size_t i = end; i > 0; --i) {
+            if (sig[i - 1] == '>') {
+                ++depth;
+            } else if (sig[i - 1] == '<' && --depth == 0) {
+                end = i - 1;
+                break;
+            }
+        }
+    }
+
+    // start of name follows the last space outside of brackets, it ends return type
+    size_t begin = 0;
+    int depth = 0;
+    for (size_t i = 0; i < end; ++i) {
+        char ch = sig[i];
+        if (ch == '<' || ch == '(') {
+            ++depth;
+        } else if ((ch == '>' || ch == ')') && depth > 0) {
+            --depth;
+        } else if (ch == ' ' && depth == 0 && !endsWith(sig.substr(0, i), op)) {
+            begin = i + 1;
+        }
+    }
+
+    if (begin >= end) {
+        return {0, sig.size()};
+    }
+    return {begin, end};
+}
+
+/**
+ * @brief The SourceLocation class
+ *
+ * Log call site captured by logging macros. Short forms of file and function are computed at
+ * compile time, @see LOG_SOURCE_LOCATION
+ */
+struct SourceLocation {
+    std::string_view file;
+    std::string_view func;
+    std::string_view file_base;
+    std::string_view func_short;
+    size_t line = 0;
+
+    constexpr SourceLocation(const char *v_file,
+                             const char *v_func,
+                             size_t v_line,
+                             size_t file_base_offset,
+                             size_t func_begin,
+                             size_t func_end) noexcept
+        : file(v_file),
+          func(v_func),
+          file_base(file.substr(file_base_offset)),
+          func_short(func.substr(func_begin, func_end - func_begin)),
+          line(v_line) {}
+};
+
+}  // namespace Log
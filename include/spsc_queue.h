@@ -0,0 +1,184 @@
+#pragma once
+
+#include <atomic>
+#include <array>
+#include <chrono>
+#include <thread>
+
+#include "default_provider.h"
+
+namespace Log {
+
+/// Size of cache line used to separate producer and consumer data
+static constexpr size_t LOGGER_CACHE_LINE_SIZE = 64;
+
+/**
+ * @brief The SpscQueue class
+ *
+ * Bounded lock-free queue with single producer and single consumer. Every slot holds sequence
+ * number telling whether it is ready to be written or read, so producer and consumer only touch
+ * slot they work with and their own index. Producer may also discard the oldest message with
+ * `dropOldest`, it competes with consumer for the head slot.
+ */
+template <typename TConfig = Config::Traits<Config::Default>>
+class SpscQueue : public IMessageQueue<SpscQueue<TConfig>, TConfig> {
+public:
+    using TMessage = LogMessage<TConfig>;
+
+    static_assert((TConfig::LOGGER_QUEUE_SIZE & (TConfig::LOGGER_QUEUE_SIZE - 1)) == 0,
+                  "LOGGER_QUEUE_SIZE must be power of two");
+
+    SpscQueue() {
+        for (size_t i = 0; i < slots.size(); ++i) {
+            slots[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    SpscQueue(const SpscQueue &) = delete;
+    SpscQueue &operator=(const SpscQueue &) = delete;
+
+    bool enqueueImpl(const TMessage &msg) {
+        TMessage *slot = claim();
+        if (slot == nullptr) {
+            return false;
+        }
+        *slot = msg;
+        publish();
+        return true;
+    }
+
+    /**
+     * @brief claim
+     * @return free slot to build message in place or nullptr if queue is full
+     *
+     * Message becomes visible to consumer after `publish`. Producer thread only
+     */
+    TMessage *claim() {
+        size_t tail = tail_idx.load(std::memory_order_relaxed);
+        Slot &slot = slots[tail & mask];
+        if (slot.seq.load(std::memory_order_acquire) != tail) {
+            return nullptr;
+        }
+        return &slot.msg;
+    }
+
+    /**
+     * @brief publish
+     *
+     * Passes message built in slot returned by `claim` to consumer. Producer thread only
+     */
+    void publish() {
+        size_t tail = tail_idx.load(std::memory_order_relaxed);
+        slots[tail & mask].seq.store(tail + 1, std::memory_order_release);
+        tail_idx.store(tail + 1, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief enqueueBlockingImpl
+     * @param msg message to place in queue
+     * @param timeout_ms time to wait for free slot, 0 waits without limit
+     * @return true if message was placed in queue
+     */
+    bool enqueueBlockingImpl(const TMessage &msg, unsigned long timeout_ms) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        while (!enqueueImpl(msg)) {
+            if (timeout_ms != 0 && std::chrono::steady_clock::now() >= deadline) {
+                return false;
+            }
+            std::this_thread::yield();
+        }
+        return true;
+    }
+
+    bool dequeueImpl(TMessage &msg) { return pop(&msg); }
+
+    /**
+     * @brief dequeueBlockingImpl
+     * @param msg place to store message
+     * @param timeout_ms time to wait for message, 0 waits without limit
+     * @return true if message was taken from queue
+     */
+    bool dequeueBlockingImpl(TMessage &msg, unsigned long timeout_ms) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        while (!dequeueImpl(msg)) {
+            if (timeout_ms != 0 && std::chrono::steady_clock::now() >= deadline) {
+                return false;
+            }
+            std::this_thread::yield();
+        }
+        return true;
+    }
+
+    /**
+     * @brief dropOldest
+     * @param dropped place to store discarded message
+     * @return true if the oldest message was discarded
+     *
+     * Can be called from producer thread to make room for a new message
+     */
+    bool dropOldest(TMessage &dropped) { return pop(&dropped); }
+
+    /**
+     * @brief empty
+     * @return true if queue has no messages
+     */
+    bool empty() const {
+        size_t head = head_idx.load(std::memory_order_acquire);
+        return slots[head & mask].seq.load(std::memory_order_acquire) != head + 1;
+    }
+
+    /**
+     * @brief position
+     * @return number of messages taken from queue so far, index of the next message to dequeue
+     */
+    size_t position() const { return head_idx.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief published
+     * @return number of messages published so far, may lag behind message just published
+     */
+    size_t published() const { return tail_idx.load(std::memory_order_relaxed); }
+
+private:
+    struct Slot {
+        std::atomic<size_t> seq;
+        TMessage msg;
+    };
+
+    /**
+     * @brief pop
+     * @param msg place to store message
+     * @return true if message was taken from queue
+     */
+    bool pop(TMessage *msg) {
+        size_t head = head_idx.load(std::memory_order_relaxed);
+        while (true) {
+            Slot &slot = slots[head & mask];
+            size_t seq = slot.seq.load(std::memory_order_acquire);
+            if (seq != head + 1) {
+                if (seq == head) {
+                    return false;  // empty
+                }
+                head = head_idx.load(std::memory_order_relaxed);
+                continue;
+            }
+            if (head_idx.compare_exchange_weak(head, head + 1, std::memory_order_relaxed)) {
+                *msg = slot.msg;
+                slot.seq.store(head + TConfig::LOGGER_QUEUE_SIZE, std::memory_order_release);
+                return true;
+            }
+        }
+    }
+
+    static constexpr size_t mask = TConfig::LOGGER_QUEUE_SIZE - 1;
+
+    /// written by producer only
+    alignas(LOGGER_CACHE_LINE_SIZE) std::atomic<size_t> tail_idx = 0;
+
+    /// written by consumer, or by producer when it drops the oldest message
+    alignas(LOGGER_CACHE_LINE_SIZE) std::atomic<size_t> head_idx = 0;
+
+    alignas(LOGGER_CACHE_LINE_SIZE) std::array<Slot, TConfig::LOGGER_QUEUE_SIZE> slots;
+};
+
+}  // namespace Log
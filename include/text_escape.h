@@ -0,0 +1,318 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+    #include <immintrin.h>
+    #define LOG_HAS_SSE2 1
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+    #include <intrin.h>
+#endif
+
+namespace Log {
+
+/**
+ * @brief countTrailingZeros
+ * @param mask non-zero bit mask
+ * @return index of the lowest set bit
+ */
+inline unsigned countTrailingZeros(unsigned mask) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long idx = 0;
+    _BitScanForward(&idx, mask);
+    return static_cast<unsigned>(idx);
+#else
+    return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+}
+
+inline bool needsJsonEscape(char ch) {
+    auto byte = static_cast<unsigned char>(ch);
+    return byte < 0x20 || ch == '"' || ch == '\\';
+}
+
+/**
+ * @brief findJsonEscape
+ * @param data string to scan
+ * @param size string length
+ * @return position of the first character that must be escaped in JSON string or `size`
+ *
+ * Checks 32 or 16 bytes at once when AVX2 or SSE2 is available.
+ */
+inline size_t findJsonEscape(const char *data, size_t size) {
+    size_t i = 0;
+#if defined(__AVX2__)
+    const __m256i quote32 = _mm256_set1_epi8('"');
+    const __m256i slash32 = _mm256_set1_epi8('\\');
+    const __m256i ctrl32 = _mm256_set1_epi8(0x1F);
+    for (; i + 32 <= size; i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+        __m256i m = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, quote32), _mm256_cmpeq_epi8(v, slash32)),
+            _mm256_cmpeq_epi8(_mm256_min_epu8(v, ctrl32), v));
+        auto mask = static_cast<unsigned>(_mm256_movemask_epi8(m));
+        if (mask != 0) {
+            return i + countTrailingZeros(mask);
+        }
+    }
+#endif
+#if defined(LOG_HAS_SSE2)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i slash = _mm_set1_epi8('\\');
+    const __m128i ctrl = _mm_set1_epi8(0x1F);
+    for (; i + 16 <= size; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        // v <= 0x1F unsigned when min(v, 0x1F) == v
+        __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, slash)),
+                                 _mm_cmpeq_epi8(_mm_min_epu8(v, ctrl), v));
+        auto mask = static_cast<unsigned>(_mm_movemask_epi8(m));
+        if (mask != 0) {
+            return i + countTrailingZeros(mask);
+        }
+    }
+#endif
+    for (; i < size; ++i) {
+        if (needsJsonEscape(data[i])) {
+            return i;
+        }
+    }
+    return size;
+}
+
+/**
+ * @brief escapeJson
+ * @param out buffer to place escaped string
+ * @param outSize size of buffer
+ * @param data string to escape
+ * @param size string length
+ * @param consumed set to number of string bytes that were copied, if not nullptr
+ * @return number of bytes written
+ *
+ * Copies string escaping quotes, backslashes and control characters. Runs without special
+ * characters are copied with single memcpy. Output is truncated on buffer end, escape sequences
+ * are never split.
+ */
+inline size_t escapeJson(
+    char *out, size_t outSize, const char *data, size_t size, size_t *consumed = nullptr) {
+    static constexpr char hex[] = "0123456789abcdef";
+    const size_t total = size;
+    size_t pos = 0;
+
+    while (size > 0 && pos < outSize) {
+        size_t run = findJsonEscape(data, size);
+        if (run > outSize - pos) {
+            run = outSize - pos;
+        }
+        std::memcpy(out + pos, data, run);
+        pos += run;
+        data += run;
+        size -= run;
+        if (size == 0 || pos == outSize) {
+            break;
+        }
+
+        char seq[6] = {'\\', 0, 0, 0, 0, 0};
+        size_t seq_len = 2;
+        switch (*data) {
+            case '"':
+                seq[1] = '"';
+                break;
+            case '\\':
+                seq[1] = '\\';
+                break;
+            case '\n':
+                seq[1] = 'n';
+                break;
+            case '\r':
+                seq[1] = 'r';
+                break;
+            case '\t':
+                seq[1] = 't';
+                break;
+            default: {
+                auto byte = static_cast<unsigned char>(*data);
+                seq[1] = 'u';
+                seq[2] = '0';
+                seq[3] = '0';
+                seq[4] = hex[byte >> 4];
+                seq[5] = hex[byte & 0xF];
+                seq_len = 6;
+                break;
+            }
+        }
+        if (pos + seq_len > outSize) {
+            break;
+        }
+        std::memcpy(out + pos, seq, seq_len);
+        pos += seq_len;
+        ++data;
+        --size;
+    }
+    if (consumed != nullptr) {
+        *consumed = total - size;
+    }
+    return pos;
+}
+
+/**
+ * @brief findUnsafe
+ * @param data string to scan
+ * @param size string length
+ * @return position of the first byte that is control character, DEL, backslash or not ASCII,
+ * or `size`
+ *
+ * Bytes below 0x20 and above 0x7F are both less than 0x20 when compared as signed, so one
+ * comparison per vector finds them.
+ */
+inline size_t findUnsafe(const char *data, size_t size) {
+    size_t i = 0;
+#if defined(__AVX2__)
+    const __m256i space32 = _mm256_set1_epi8(0x20);
+    const __m256i del32 = _mm256_set1_epi8(0x7F);
+    const __m256i backslash32 = _mm256_set1_epi8('\\');
+    for (; i + 32 <= size; i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+        __m256i m = _mm256_or_si256(_mm256_cmpgt_epi8(space32, v), _mm256_cmpeq_epi8(v, del32));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, backslash32));
+        auto mask = static_cast<unsigned>(_mm256_movemask_epi8(m));
+        if (mask != 0) {
+            return i + countTrailingZeros(mask);
+        }
+    }
+#endif
+#if defined(LOG_HAS_SSE2)
+    const __m128i space = _mm_set1_epi8(0x20);
+    const __m128i del = _mm_set1_epi8(0x7F);
+    const __m128i backslash = _mm_set1_epi8('\\');
+    for (; i + 16 <= size; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        __m128i m = _mm_or_si128(_mm_cmplt_epi8(v, space), _mm_cmpeq_epi8(v, del));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, backslash));
+        auto mask = static_cast<unsigned>(_mm_movemask_epi8(m));
+        if (mask != 0) {
+            return i + countTrailingZeros(mask);
+        }
+    }
+#endif
+    for (; i < size; ++i) {
+        auto byte = static_cast<unsigned char>(data[i]);
+        if (byte < 0x20 || byte >= 0x7F || byte == '\\') {
+            return i;
+        }
+    }
+    return size;
+}
+
+/**
+ * @brief utf8SequenceLength
+ * @param data string starting with non-ASCII byte
+ * @param size string length
+ * @return length of valid UTF-8 sequence at the start of string, 0 if it is invalid
+ *
+ * Rejects overlong forms, surrogates and code points above U+10FFFF.
+ */
+inline size_t utf8SequenceLength(const char *data, size_t size) {
+    const auto *bytes = reinterpret_cast<const unsigned char *>(data);
+    auto cont = [bytes, size](size_t idx, unsigned char low, unsigned char high) {
+        return idx < size && bytes[idx] >= low && bytes[idx] <= high;
+    };
+
+    unsigned char lead = bytes[0];
+    if (lead >= 0xC2 && lead <= 0xDF) {
+        return cont(1, 0x80, 0xBF) ? 2 : 0;
+    }
+    if (lead >= 0xE0 && lead <= 0xEF) {
+        unsigned char low = lead == 0xE0 ? 0xA0 : 0x80;
+        unsigned char high = lead == 0xED ? 0x9F : 0xBF;
+        return cont(1, low, high) && cont(2, 0x80, 0xBF) ? 3 : 0;
+    }
+    if (lead >= 0xF0 && lead <= 0xF4) {
+        unsigned char low = lead == 0xF0 ? 0x90 : 0x80;
+        unsigned char high = lead == 0xF4 ? 0x8F : 0xBF;
+        return cont(1, low, high) && cont(2, 0x80, 0xBF) && cont(3, 0x80, 0xBF) ? 4 : 0;
+    }
+    return 0;
+}
+
+/**
+ * @brief sanitizeText
+ * @param out buffer to place sanitized string
+ * @param outSize size of buffer
+ * @param data string to sanitize
+ * @param size string length
+ * @return number of bytes written
+ *
+ * Copies string replacing control characters, DEL and bytes of invalid UTF-8 with "\\n", "\\r",
+ * "\\t" or "\\xHH". Backslash becomes "\\\\", so escape sequences in output can not be forged.
+ * Printable ASCII runs are copied with single memcpy. Output is truncated on buffer end, escape
+ * sequences and UTF-8 characters are never split.
+ */
+inline size_t sanitizeText(char *out, size_t outSize, const char *data, size_t size) {
+    static constexpr char hex[] = "0123456789abcdef";
+    size_t pos = 0;
+
+    while (size > 0 && pos < outSize) {
+        size_t run = findUnsafe(data, size);
+        if (run > outSize - pos) {
+            run = outSize - pos;
+        }
+        std::memcpy(out + pos, data, run);
+        pos += run;
+        data += run;
+        size -= run;
+        if (size == 0 || pos == outSize) {
+            break;
+        }
+
+        auto byte = static_cast<unsigned char>(*data);
+        if (byte >= 0x80) {
+            size_t seq_len = utf8SequenceLength(data, size);
+            if (seq_len != 0) {
+                if (pos + seq_len > outSize) {
+                    break;
+                }
+                std::memcpy(out + pos, data, seq_len);
+                pos += seq_len;
+                data += seq_len;
+                size -= seq_len;
+                continue;
+            }
+        }
+
+        char seq[4] = {'\\', 0, 0, 0};
+        size_t seq_len = 2;
+        switch (*data) {
+            case '\\':
+                seq[1] = '\\';
+                break;
+            case '\n':
+                seq[1] = 'n';
+                break;
+            case '\r':
+                seq[1] = 'r';
+                break;
+            case '\t':
+                seq[1] = 't';
+                break;
+            default:
+                seq[1] = 'x';
+                seq[2] = hex[byte >> 4];
+                seq[3] = hex[byte & 0xF];
+                seq_len = 4;
+                break;
+        }
+        if (pos + seq_len > outSize) {
+            break;
+        }
+        std::memcpy(out + pos, seq, seq_len);
+        pos += seq_len;
+        ++data;
+        --size;
+    }
+    return pos;
+}
+
+}  // namespace Log
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+#if defined(_WIN32)
+    #include <process.h>
+#else
+    #include <unistd.h>
+#endif
+
+#include "logger.h"
+#include "text_escape.h"
+
+namespace Log {
+
+/**
+ * @brief The TraceEventSink class
+ *
+ * Writes spans measured by `LOG_SCOPE` to file in Chrome trace event format, that can be opened
+ * in Perfetto or chrome://tracing. Every span is "complete" event with name, level as category,
+ * process and thread id and call site in arguments. Ordinary messages are not written.
+ *
+ * File is JSON array closed when the last copy of sink is destroyed, viewers also accept file
+ * left unclosed by crash. Events are buffered, `flush` passes them to the kernel.
+ */
+class TraceEventSink : public ILogSink<TraceEventSink> {
+public:
+    /// spans come to `spanImpl`
+    static constexpr bool usesSpans = true;
+
+    explicit TraceEventSink(const std::string &path)
+        : writer(std::make_shared<Writer>(path)) {}
+
+    void sendImpl([[maybe_unused]] const level msgType,
+                  [[maybe_unused]] const char *data,
+                  [[maybe_unused]] size_t size) const {}
+
+    void spanImpl(const LogRecord &record, const Span &span) const { writer->write(record, span); }
+
+    /**
+     * @brief flush
+     *
+     * Passes buffered events to the kernel
+     */
+    void flush() const { writer->flush(); }
+
+    /**
+     * @brief isOpen
+     * @return false if file could not be opened, spans are discarded then
+     */
+    bool isOpen() const { return writer->isOpen(); }
+
+private:
+    class Writer {
+    public:
+        static constexpr size_t file_buffer_size = 64 * 1024;
+        static constexpr size_t max_event_size = 1024;
+
+        explicit Writer(const std::string &path)
+            : file(std::fopen(path.c_str(), "wb")) {
+#if defined(_WIN32)
+            pid = static_cast<long>(_getpid());
+#else
+            pid = static_cast<long>(getpid());
+#endif
+            if (file != nullptr) {
+                std::setvbuf(file, nullptr, _IOFBF, file_buffer_size);
+                std::fputs("[", file);
+            }
+        }
+
+        Writer(const Writer &) = delete;
+        Writer &operator=(const Writer &) = delete;
+
+        ~Writer() {
+            if (file != nullptr) {
+                std::fputs("\n]\n", file);
+                std::fclose(file);
+            }
+        }
+
+        void write(const LogRecord &record, const Span &span) {
+            if (file == nullptr) {
+                return;
+            }
+            std::array<char, max_event_size> event;
+            size_t pos = 0;
+            auto append = [&](std::string_view text) {
+                size_t len = std::min(text.size(), event.size() - pos);
+                std::memcpy(event.data() + pos, text.data(), len);
+                pos += len;
+            };
+            auto appendEscaped = [&](std::string_view text) {
+                pos += escapeJson(event.data() + pos, event.size() - pos, text.data(), text.size());
+            };
+            auto appendFormat = [&](auto &&...args) {
+                auto res = fmt::format_to_n(event.data() + pos, event.size() - pos, args...);
+                pos += std::min(res.size, event.size() - pos);
+            };
+
+            const long long duration = span.end > span.begin ? span.end - span.begin : 0;
+            append("\n{\"name\":\"");
+            appendEscaped(span.name);
+            append("\",\"cat\":\"");
+            append(msg_log_types[static_cast<size_t>(record.msgType)]);
+            // trace event times are microseconds, fraction keeps nanoseconds
+            appendFormat("\",\"ph\":\"X\",\"ts\":{}.{:03},\"dur\":{}.{:03},\"pid\":{},\"tid\":{}",
+                         span.begin / 1000, span.begin % 1000, duration / 1000, duration % 1000,
+                         pid, span.thread);
+            append(",\"args\":{\"file\":\"");
+            appendEscaped(record.file_base);
+            appendFormat("\",\"line\":{},\"function\":\"", record.line);
+            appendEscaped(record.func_short);
+            append("\"}}");
+            if (pos == event.size()) {
+                // truncated event would break the file
+                return;
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!first) {
+                std::fputc(',', file);
+            }
+            first = false;
+            std::fwrite(event.data(), 1, pos, file);
+        }
+
+        void flush() {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (file != nullptr) {
+                std::fflush(file);
+            }
+        }
+
+        bool isOpen() const { return file != nullptr; }
+
+    private:
+        std::mutex mutex;
+        std::FILE *file;
+        long pid = 0;
+        /// no separator before the first event
+        bool first = true;
+    };
+
+    std::shared_ptr<Writer> writer;
+};
+
+}  // namespace Log
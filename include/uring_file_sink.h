@@ -0,0 +1,532 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+    #include <linux/io_uring.h>
+    #include <sys/mman.h>
+    #include <sys/syscall.h>
+#endif
+
+#include "buffered_writer.h"
+#include "log_index.h"
+#include "logger.h"
+
+namespace Log {
+
+/**
+ * @brief The UringFileSink class
+ *
+ * File sink for high volume logs. Messages are rendered directly in large page aligned buffers,
+ * full buffers are written by background thread. On Linux buffers are registered in io_uring and
+ * written with `IORING_OP_WRITE_FIXED`, all ready buffers are submitted with single syscall and
+ * several writes are in flight at once. If io_uring is not available (old kernel, seccomp,
+ * memlock limit) the same thread writes ready buffers with one `pwritev` call. Short writes are
+ * continued, failed writes are retried once with `pwrite` and then counted by `failedWrites`.
+ *
+ * Messages are appended to existing file. Sink is a handle, copies share the same file. File is
+ * flushed and closed when the last copy is destroyed.
+ *
+ * With `write_index` sparse index "<path>.idx" gets time range and levels of every
+ * `index_interval` bytes of file, @see log_index.h. `cpplog-query` uses it.
+ */
+class UringFileSink : public ILogSink<UringFileSink> {
+public:
+    struct Options {
+        /// size of one buffer, rounded up to page size. Also the longest message
+        size_t buffer_size = 1024 * 1024;
+        /// number of buffers, buffers in flight are not available to logging threads
+        size_t buffers = 8;
+        /// time after which partially filled buffer is written
+        unsigned long flush_interval_ms = 1000;
+        /// set to false to always use `pwritev`
+        bool use_uring = true;
+        /// write index entry for every `index_interval` bytes
+        bool write_index = false;
+        /// size of indexed block, it ends with the first message after this size
+        size_t index_interval = 64 * 1024;
+    };
+
+    /// messages are rendered directly in write buffer
+    static constexpr bool supportsReserve = true;
+    /// timestamps go to index
+    static constexpr bool usesTimestamp = true;
+
+    explicit UringFileSink(const std::string &path)
+        : UringFileSink(path, Options()) {}
+
+    UringFileSink(const std::string &path, const Options &options)
+        : writer(std::make_shared<Writer>(path, options)) {}
+
+    void sendImpl(const level msgType, long timestamp, const char *data, size_t size) const {
+        char *buf = writer->reserve(size);
+        if (buf != nullptr) {
+            std::memcpy(buf, data, size);
+            writer->commit(msgType, timestamp, buf, size);
+        }
+    }
+
+    char *reserveImpl(size_t size) const { return writer->reserve(size); }
+
+    void commitImpl(const level msgType, long timestamp, char *data, size_t size) const {
+        writer->commit(msgType, timestamp, data, size);
+    }
+
+    /**
+     * @brief flush
+     *
+     * Writes partially filled buffer and waits until all buffers are written
+     */
+    void flush() const { writer->flush(); }
+
+    /**
+     * @brief isOpen
+     * @return false if file could not be opened or buffers allocated, messages are discarded then
+     */
+    bool isOpen() const { return writer->isOpen(); }
+
+    /**
+     * @brief failedWrites
+     * @return number of buffers that could not be written whole even after retries
+     */
+    size_t failedWrites() const { return writer->failedWrites(); }
+
+    /**
+     * @brief usesUring
+     * @return true if buffers are written with io_uring, false if `pwritev` fallback is used
+     */
+    bool usesUring() const { return writer->usesUring(); }
+
+private:
+#if defined(__linux__)
+    /**
+     * @brief The Uring class
+     *
+     * Minimal io_uring wrapper over raw syscalls, only what writer needs
+     */
+    class Uring {
+    public:
+        Uring() = default;
+        Uring(const Uring &) = delete;
+        Uring &operator=(const Uring &) = delete;
+
+        ~Uring() {
+            if (sqes != nullptr) {
+                munmap(sqes, sqes_size);
+            }
+            if (cq_ring != nullptr && cq_ring != sq_ring) {
+                munmap(cq_ring, cq_ring_size);
+            }
+            if (sq_ring != nullptr) {
+                munmap(sq_ring, sq_ring_size);
+            }
+            if (ring_fd >= 0) {
+                close(ring_fd);
+            }
+        }
+
+        /**
+         * @brief init
+         * @param entries queue depth
+         * @param buffers buffers to register, written with `WRITE_FIXED`
+         * @return false if io_uring can not be used
+         */
+        template <typename TBuffer>
+        bool init(unsigned entries, const std::vector<TBuffer> &buffers, size_t buffer_size) {
+            io_uring_params params = {};
+            ring_fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+            if (ring_fd < 0) {
+                return false;
+            }
+
+            sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+            cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+            if ((params.features & IORING_FEAT_SINGLE_MMAP) != 0) {
+                sq_ring_size = std::max(sq_ring_size, cq_ring_size);
+                cq_ring_size = sq_ring_size;
+            }
+            sq_ring = map(sq_ring_size, IORING_OFF_SQ_RING);
+            if (sq_ring == nullptr) {
+                return false;
+            }
+            cq_ring = (params.features & IORING_FEAT_SINGLE_MMAP) != 0
+                          ? sq_ring
+                          : map(cq_ring_size, IORING_OFF_CQ_RING);
+            sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+            sqes = static_cast<io_uring_sqe *>(map(sqes_size, IORING_OFF_SQES));
+            if (cq_ring == nullptr || sqes == nullptr) {
+                return false;
+            }
+
+            auto *sq = static_cast<char *>(sq_ring);
+            sq_head = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+            sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+            sq_mask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+            sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+            auto *cq = static_cast<char *>(cq_ring);
+            cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+            cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+            cq_mask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+            cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+            capacity = params.sq_entries;
+
+            std::vector<iovec> iovs(buffers.size());
+            for (size_t i = 0; i < buffers.size(); ++i) {
+                iovs[i] = {buffers[i].data, buffer_size};
+            }
+            // pinned buffers count against RLIMIT_MEMLOCK, caller falls back if it is too low
+            return syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_BUFFERS, iovs.data(),
+                           static_cast<unsigned>(iovs.size())) == 0;
+        }
+
+        /// number of free submission slots
+        unsigned space() const {
+            return capacity - (*sq_tail + unpublished - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE));
+        }
+
+        /**
+         * @brief prepareWrite
+         *
+         * Places write of registered buffer `idx` in submission queue, `submit` passes it to
+         * kernel
+         */
+        void prepareWrite(int fd, const char *data, size_t len, uint64_t offset, size_t idx) {
+            unsigned tail = *sq_tail + unpublished;
+            unsigned slot = tail & sq_mask;
+            io_uring_sqe &sqe = sqes[slot];
+            std::memset(&sqe, 0, sizeof(sqe));
+            sqe.opcode = IORING_OP_WRITE_FIXED;
+            sqe.fd = fd;
+            sqe.addr = reinterpret_cast<uint64_t>(data);
+            sqe.len = static_cast<uint32_t>(len);
+            sqe.off = offset;
+            sqe.buf_index = static_cast<uint16_t>(idx);
+            sqe.user_data = idx;
+            sq_array[slot] = slot;
+            ++unpublished;
+        }
+
+        /**
+         * @brief submit
+         * @param wait wait for at least one completion
+         *
+         * Submits all prepared writes with single syscall
+         */
+        void submit(bool wait) {
+            if (unpublished != 0) {
+                __atomic_store_n(sq_tail, *sq_tail + unpublished, __ATOMIC_RELEASE);
+                unpublished = 0;
+            }
+            // entries kernel did not take last time are submitted again
+            unsigned to_submit = *sq_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+            if (to_submit == 0 && !wait) {
+                return;
+            }
+            unsigned flags = wait ? IORING_ENTER_GETEVENTS : 0;
+            syscall(__NR_io_uring_enter, ring_fd, to_submit, wait ? 1U : 0U, flags, nullptr, 0);
+        }
+
+        /**
+         * @brief reap
+         * @param complete called with buffer index and write result for every completion
+         */
+        template <typename TCallback>
+        void reap(const TCallback &complete) {
+            unsigned head = *cq_head;
+            unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+            for (; head != tail; ++head) {
+                const io_uring_cqe &cqe = cqes[head & cq_mask];
+                complete(static_cast<size_t>(cqe.user_data), cqe.res);
+            }
+            __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+        }
+
+    private:
+        void *map(size_t size, uint64_t offset) const {
+            void *ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                             ring_fd, static_cast<off_t>(offset));
+            return ptr == MAP_FAILED ? nullptr : ptr;
+        }
+
+        int ring_fd = -1;
+        void *sq_ring = nullptr;
+        void *cq_ring = nullptr;
+        size_t sq_ring_size = 0;
+        size_t cq_ring_size = 0;
+        io_uring_sqe *sqes = nullptr;
+        size_t sqes_size = 0;
+
+        unsigned *sq_head = nullptr;
+        unsigned *sq_tail = nullptr;
+        unsigned *sq_array = nullptr;
+        unsigned sq_mask = 0;
+        unsigned *cq_head = nullptr;
+        unsigned *cq_tail = nullptr;
+        unsigned cq_mask = 0;
+        io_uring_cqe *cqes = nullptr;
+        unsigned capacity = 0;
+        /// prepared writes not yet visible to kernel
+        unsigned unpublished = 0;
+    };
+#endif
+
+    class Writer : public BufferedWriter<Writer> {
+    public:
+        static constexpr size_t page_size = 4096;
+
+        Writer(const std::string &path, const Options &opts)
+            : BufferedWriter((opts.buffer_size + page_size - 1) / page_size * page_size,
+                             opts.buffers,
+                             page_size,
+                             opts.flush_interval_ms),
+              options(opts) {
+            if (options.write_index) {
+                // block ends with the first message after `index_interval`, so blocks of buffer
+                // are at least that long
+                reserveEntries(capacity / std::max<size_t>(options.index_interval, 1) + 1);
+            }
+            fd = open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+            if (fd >= 0) {
+                file_offset = static_cast<uint64_t>(lseek(fd, 0, SEEK_END));
+                index_offset = file_offset;
+                if (options.write_index) {
+                    // index of empty file is stale
+                    index.open(Index::indexPath(path), Index::dataFormat::Text, file_offset != 0);
+                }
+            }
+#if defined(__linux__)
+            if (options.use_uring && fd >= 0 && !buffers.empty()) {
+                uring = std::make_unique<Uring>();
+                if (!uring->init(static_cast<unsigned>(buffers.size()), buffers, capacity)) {
+                    uring.reset();
+                }
+            }
+#endif
+            start();
+        }
+
+        ~Writer() {
+            stop();
+            if (options.write_index && !block.empty()) {
+                block.size = static_cast<uint32_t>(index_offset - block.offset);
+                index.add(block);
+            }
+#if defined(__linux__)
+            uring.reset();
+#endif
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+
+        void commitImpl(Buffer &buf, level msgType, long timestamp, size_t size) {
+            if (!options.write_index) {
+                return;
+            }
+            if (block.empty()) {
+                block.offset = index_offset;
+            }
+            block.add(msgType, timestamp);
+            index_offset += size;
+            if (index_offset - block.offset >= options.index_interval) {
+                block.size = static_cast<uint32_t>(index_offset - block.offset);
+                buf.entries.push_back(block);
+                block = Index::Entry();
+            }
+        }
+
+        /**
+         * @brief writeImpl
+         *
+         * Writes pending buffers. Waits for io_uring completion only if nothing new was
+         * submitted, so ready buffers are never kept behind slow write.
+         */
+        void writeImpl(const std::vector<size_t> &ready, std::vector<size_t> &done) {
+            for (size_t idx : ready) {
+                pending.push_back({idx, 0});
+            }
+            if (fd < 0 || buffers.empty()) {
+                for (const Write &w : pending) {
+                    failedWrite();
+                    done.push_back(w.idx);
+                }
+                pending.clear();
+                return;
+            }
+#if defined(__linux__)
+            if (uring != nullptr) {
+                writeUring(done);
+            } else {
+                writeFallback(done);
+            }
+#else
+            writeFallback(done);
+#endif
+            if (options.write_index && !done.empty()) {
+                // written buffers are not used by other threads until they are free
+                for (size_t idx : done) {
+                    for (const Index::Entry &entry : buffers[idx].entries) {
+                        index.add(entry);
+                    }
+                }
+                index.flush();
+            }
+        }
+
+        bool idleImpl() const { return pending.empty() && in_flight == 0; }
+
+        bool isOpen() const { return fd >= 0 && !buffers.empty(); }
+
+        bool usesUring() const {
+#if defined(__linux__)
+            return uring != nullptr;
+#else
+            return false;
+#endif
+        }
+
+    private:
+        /// buffer with part that is not written yet
+        struct Write {
+            size_t idx;
+            size_t done;
+        };
+
+#if defined(__linux__)
+        void writeUring(std::vector<size_t> &done) {
+            bool submitted = false;
+            while (!pending.empty() && uring->space() != 0) {
+                const Write w = pending.front();
+                pending.pop_front();
+                const Buffer &buf = buffers[w.idx];
+                offsets_of[w.idx] = file_offset + w.done;
+                done_of[w.idx] = w.done;
+                uring->prepareWrite(fd, buf.data + w.done, buf.len - w.done, file_offset + w.done,
+                                    w.idx);
+                file_offset += buf.len - w.done;
+                ++in_flight;
+                submitted = true;
+            }
+            uring->submit(!submitted);
+
+            uring->reap([this, &done](size_t idx, int res) {
+                --in_flight;
+                const Buffer &buf = buffers[idx];
+                const size_t remaining = buf.len - done_of[idx];
+                if (res >= 0 && static_cast<size_t>(res) == remaining) {
+                    done.push_back(idx);
+                    return;
+                }
+                // the rest goes to its own offset, offsets of later buffers are taken already
+                const size_t progress = res > 0 ? static_cast<size_t>(res) : 0;
+                const size_t written = done_of[idx] + progress;
+                const uint64_t offset = offsets_of[idx] + progress;
+                if (res > 0 && uring->space() != 0) {
+                    offsets_of[idx] = offset;
+                    done_of[idx] = written;
+                    uring->prepareWrite(fd, buf.data + written, buf.len - written, offset, idx);
+                    ++in_flight;
+                    return;
+                }
+                // failed write, or short one without room in ring, is finished synchronously
+                if (!pwriteAll(buf.data + written, buf.len - written, offset)) {
+                    failedWrite();
+                }
+                done.push_back(idx);
+            });
+        }
+#endif
+
+        void writeFallback(std::vector<size_t> &done) {
+            // buffers are consecutive in file, so all of them go with one pwritev
+            std::vector<iovec> iovs;
+            iovs.reserve(pending.size());
+            size_t total = 0;
+            for (const Write &w : pending) {
+                iovs.push_back({buffers[w.idx].data + w.done, buffers[w.idx].len - w.done});
+                total += buffers[w.idx].len - w.done;
+                done.push_back(w.idx);
+            }
+            pending.clear();
+
+            size_t first = 0;
+            while (total != 0 && first < iovs.size()) {
+                int count = static_cast<int>(std::min<size_t>(iovs.size() - first, IOV_MAX));
+                ssize_t res = pwritev(fd, iovs.data() + first, count,
+                                      static_cast<off_t>(file_offset));
+                if (res < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (res <= 0) {
+                    // the rest is skipped, so index offsets still match file
+                    for (; first < iovs.size(); ++first) {
+                        failedWrite();
+                    }
+                    file_offset += total;
+                    return;
+                }
+                file_offset += static_cast<uint64_t>(res);
+                total -= static_cast<size_t>(res);
+                auto left = static_cast<size_t>(res);
+                while (first < iovs.size() && left >= iovs[first].iov_len) {
+                    left -= iovs[first].iov_len;
+                    ++first;
+                }
+                if (left != 0) {
+                    iovs[first].iov_base = static_cast<char *>(iovs[first].iov_base) + left;
+                    iovs[first].iov_len -= left;
+                }
+            }
+        }
+
+        /// writes data at offset, retries short and interrupted writes
+        bool pwriteAll(const char *data, size_t len, uint64_t offset) const {
+            while (len != 0) {
+                ssize_t res = pwrite(fd, data, len, static_cast<off_t>(offset));
+                if (res < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (res <= 0) {
+                    return false;
+                }
+                data += res;
+                len -= static_cast<size_t>(res);
+                offset += static_cast<uint64_t>(res);
+            }
+            return true;
+        }
+
+        const Options options;
+        /// file offset after the last committed message, guarded by mutex
+        uint64_t index_offset = 0;
+        /// block being indexed, guarded by mutex
+        Index::Entry block;
+
+        /// used by background thread only
+        int fd = -1;
+        uint64_t file_offset = 0;
+        std::deque<Write> pending;
+        size_t in_flight = 0;
+        std::vector<uint64_t> offsets_of = std::vector<uint64_t>(buffers.size());
+        std::vector<size_t> done_of = std::vector<size_t>(buffers.size());
+        Index::Writer index;
+#if defined(__linux__)
+        std::unique_ptr<Uring> uring;
+#endif
+    };
+
+    std::shared_ptr<Writer> writer;
+};
+
+}  // namespace Log
@@ -0,0 +1,56 @@
+#include <cstdio>
+#include <vector>
+
+#include "log_frame.h"
+
+/**
+ * cpplog-cat: writes uncompressed content of files created by `Log::CompressedFileSink` to
+ * stdout. Damaged file is printed up to the last complete block.
+ */
+
+static bool catFile(const char *path) {
+    std::FILE *file = std::fopen(path, "rb");
+    if (file == nullptr) {
+        std::fprintf(stderr, "cpplog-cat: %s: can not open file\n", path);
+        return false;
+    }
+
+    Log::Frame::Reader reader(file);
+    if (!reader.open()) {
+        std::fprintf(stderr, "cpplog-cat: %s: not a compressed log file\n", path);
+        std::fclose(file);
+        return false;
+    }
+
+    std::vector<char> block;
+    Log::Frame::Reader::status status = Log::Frame::Reader::status::Ok;
+    while ((status = reader.next(block)) == Log::Frame::Reader::status::Ok) {
+        std::fwrite(block.data(), 1, block.size(), stdout);
+    }
+    std::fclose(file);
+
+    if (status == Log::Frame::Reader::status::Truncated) {
+        std::fprintf(stderr, "cpplog-cat: %s: incomplete block at offset %zu\n", path,
+                     reader.offset());
+        return false;
+    }
+    if (status == Log::Frame::Reader::status::Corrupted) {
+        std::fprintf(stderr, "cpplog-cat: %s: damaged block at offset %zu\n", path,
+                     reader.offset());
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        std::fprintf(stderr, "usage: cpplog-cat FILE...\n");
+        return 2;
+    }
+
+    bool ok = true;
+    for (int i = 1; i < argc; ++i) {
+        ok = catFile(argv[i]) && ok;
+    }
+    return ok ? 0 : 1;
+}
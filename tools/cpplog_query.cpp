@@ -0,0 +1,466 @@
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "log_frame.h"
+#include "log_index.h"
+
+/**
+ * cpplog-query: prints messages of given levels and time range from log files. Index written
+ * by file sink with `write_index` ("<file>.idx") tells which blocks may contain such messages,
+ * only they are read and they are parsed in parallel. Parts of file not covered by index are
+ * scanned whole. Plain text and `Log::CompressedFileSink` files are supported.
+ *
+ * Time range is checked per block, level and text per line. Line without level name belongs to
+ * the message above it. Lines have no timestamp the tool could rely on, so block that is only
+ * partly in time range, or part of file without index, is printed whole and the number of such
+ * blocks is reported: output is a superset of messages in time range.
+ */
+
+using Log::Index::dataFormat;
+using Log::msg_log_types;
+
+namespace {
+
+constexpr uint32_t all_levels = (1U << msg_log_types.size()) - 1;
+/// size of text read by one task when there is no index
+constexpr uint64_t scan_chunk = 4 * 1024 * 1024;
+
+struct Query {
+    int64_t from = std::numeric_limits<int64_t>::min();
+    int64_t to = std::numeric_limits<int64_t>::max();
+    uint32_t levels = all_levels;
+    std::string text;
+};
+
+/// part of file parsed by one worker
+struct Task {
+    const char *path;
+    dataFormat format;
+    uint64_t offset;
+    uint64_t size;
+    /// text task starts at line start and ends after line end, it is index block
+    bool exact;
+    /// part of file may have messages outside time range
+    bool partial;
+};
+
+struct Result {
+    std::string out;
+    std::string error;
+    bool done = false;
+};
+
+bool isWordChar(char c) {
+    return std::isalnum(static_cast<unsigned char>(c)) != 0 || c == '_';
+}
+
+/**
+ * @brief lineLevel
+ * @return bit of the first level name in line, 0 if line has no level
+ */
+uint32_t lineLevel(std::string_view line) {
+    size_t best = std::string_view::npos;
+    uint32_t bit = 0;
+    for (size_t i = 0; i < msg_log_types.size(); ++i) {
+        for (size_t pos = line.find(msg_log_types[i]); pos < best;
+             pos = line.find(msg_log_types[i], pos + 1)) {
+            size_t end = pos + msg_log_types[i].size();
+            if ((pos == 0 || !isWordChar(line[pos - 1])) &&
+                (end == line.size() || !isWordChar(line[end]))) {
+                best = pos;
+                bit = 1U << i;
+                break;
+            }
+        }
+    }
+    return bit;
+}
+
+void filterLines(const char *data, size_t size, const Query &query, std::string &out) {
+    std::string_view rest(data, size);
+    bool keep = false;
+    while (!rest.empty()) {
+        size_t nl = rest.find('\n');
+        size_t len = nl == std::string_view::npos ? rest.size() : nl + 1;
+        std::string_view line = rest.substr(0, len);
+        rest.remove_prefix(len);
+
+        if (query.levels != all_levels) {
+            uint32_t bit = lineLevel(line);
+            if (bit != 0) {
+                keep = (query.levels & bit) != 0;
+            }
+        } else {
+            keep = true;
+        }
+        if (keep && (query.text.empty() || line.find(query.text) != std::string_view::npos)) {
+            out.append(line.data(), line.size());
+        }
+    }
+}
+
+bool readAt(std::FILE *file, uint64_t offset, size_t size, std::vector<char> &buf) {
+    buf.resize(size);
+    if (std::fseek(file, static_cast<long>(offset), SEEK_SET) != 0) {
+        return false;
+    }
+    buf.resize(std::fread(buf.data(), 1, size, file));
+    return true;
+}
+
+void runTextTask(std::FILE *file, const Task &task, const Query &query, Result &result) {
+    std::vector<char> buf;
+    // byte before chunk tells if chunk starts at line start
+    const bool look_back = !task.exact && task.offset != 0;
+    const uint64_t begin = look_back ? task.offset - 1 : task.offset;
+    if (!readAt(file, begin, task.size + (look_back ? 1 : 0), buf)) {
+        result.error = "read failed";
+        return;
+    }
+
+    size_t pos = 0;
+    if (look_back) {
+        // line that started before chunk belongs to previous task
+        auto nl = std::find(buf.begin(), buf.end(), '\n');
+        pos = nl == buf.end() ? buf.size() : static_cast<size_t>(nl - buf.begin()) + 1;
+    }
+    if (!task.exact && pos < buf.size() && buf.back() != '\n') {
+        // the last line ends after chunk
+        std::array<char, 64 * 1024> more;
+        size_t got = 0;
+        while ((got = std::fread(more.data(), 1, more.size(), file)) != 0) {
+            auto nl = std::find(more.begin(), more.begin() + got, '\n');
+            buf.insert(buf.end(), more.begin(), nl == more.begin() + got ? nl : nl + 1);
+            if (nl != more.begin() + got) {
+                break;
+            }
+        }
+    }
+    if (pos < buf.size()) {
+        filterLines(buf.data() + pos, buf.size() - pos, query, result.out);
+    }
+}
+
+void runCompressedTask(std::FILE *file, const Task &task, const Query &query, Result &result) {
+    if (std::fseek(file, static_cast<long>(task.offset), SEEK_SET) != 0) {
+        result.error = "read failed";
+        return;
+    }
+    Log::Frame::Reader reader(file);
+    std::vector<char> block;
+    Log::Frame::Reader::status status = reader.next(block);
+    if (status == Log::Frame::Reader::status::Ok) {
+        filterLines(block.data(), block.size(), query, result.out);
+    } else if (status != Log::Frame::Reader::status::End) {
+        result.error = "damaged block at offset " + std::to_string(task.offset);
+    }
+}
+
+void runTask(const Task &task, const Query &query, Result &result) {
+    std::FILE *file = std::fopen(task.path, "rb");
+    if (file == nullptr) {
+        result.error = "can not open file";
+        return;
+    }
+    if (task.format == dataFormat::Compressed) {
+        runCompressedTask(file, task, query, result);
+    } else {
+        runTextTask(file, task, query, result);
+    }
+    std::fclose(file);
+}
+
+/// adds tasks for part of file that index does not describe
+void addUnindexed(const char *path,
+                  dataFormat format,
+                  std::FILE *file,
+                  uint64_t begin,
+                  uint64_t end,
+                  std::vector<Task> &tasks) {
+    if (format == dataFormat::Text) {
+        for (uint64_t offset = begin; offset < end; offset += scan_chunk) {
+            tasks.push_back({path, format, offset, std::min(scan_chunk, end - offset), false,
+                             true});
+        }
+        return;
+    }
+    // headers tell where blocks are, blocks are parsed in parallel
+    std::array<char, Log::Frame::BLOCK_HEADER_SIZE> header;
+    uint64_t offset = begin;
+    while (offset < end && std::fseek(file, static_cast<long>(offset), SEEK_SET) == 0 &&
+           std::fread(header.data(), 1, header.size(), file) == header.size()) {
+        if (std::memcmp(header.data(), Log::Frame::BLOCK_MAGIC.data(),
+                        Log::Frame::BLOCK_MAGIC.size()) != 0) {
+            // task reports damaged block
+            tasks.push_back({path, format, offset, header.size(), true, true});
+            return;
+        }
+        uint64_t size = header.size() + (Log::Frame::read32(header.data() + 8) &
+                                         ~Log::Frame::STORED_RAW);
+        tasks.push_back({path, format, offset, size, true, true});
+        offset += size;
+    }
+}
+
+/**
+ * @brief planFile
+ * @return false if file can not be read
+ */
+bool planFile(const char *path, const Query &query, std::vector<Task> &tasks) {
+    std::FILE *file = std::fopen(path, "rb");
+    if (file == nullptr) {
+        std::fprintf(stderr, "cpplog-query: %s: can not open file\n", path);
+        return false;
+    }
+    std::fseek(file, 0, SEEK_END);
+    const auto file_size = static_cast<uint64_t>(std::ftell(file));
+    std::rewind(file);
+
+    std::array<char, Log::Frame::FILE_HEADER_SIZE> header = {};
+    const bool compressed =
+        std::fread(header.data(), 1, header.size(), file) == header.size() &&
+        std::memcmp(header.data(), Log::Frame::FILE_MAGIC.data(), Log::Frame::FILE_MAGIC.size()) ==
+            0;
+    const dataFormat format = compressed ? dataFormat::Compressed : dataFormat::Text;
+
+    std::vector<Log::Index::Entry> entries;
+    const std::string index_path = Log::Index::indexPath(path);
+    if (std::FILE *index = std::fopen(index_path.c_str(), "rb")) {
+        dataFormat index_format = dataFormat::Text;
+        if (!Log::Index::read(index, index_format, entries) || index_format != format) {
+            std::fprintf(stderr, "cpplog-query: %s: index does not match file, ignored\n",
+                         index_path.c_str());
+            entries.clear();
+        }
+        std::fclose(index);
+    }
+
+    uint64_t covered = compressed ? Log::Frame::FILE_HEADER_SIZE : 0;
+    for (const Log::Index::Entry &entry : entries) {
+        if (entry.offset < covered || entry.offset + entry.size > file_size) {
+            // overlapping entry or block that is not in file
+            continue;
+        }
+        addUnindexed(path, format, file, covered, entry.offset, tasks);
+        if (entry.matches(query.from, query.to, query.levels)) {
+            tasks.push_back({path, format, entry.offset, entry.size, true,
+                             !entry.within(query.from, query.to)});
+        }
+        covered = entry.offset + entry.size;
+    }
+    addUnindexed(path, format, file, covered, file_size, tasks);
+    std::fclose(file);
+    return true;
+}
+
+bool hasTimeRange(const Query &query) {
+    return query.from != std::numeric_limits<int64_t>::min() ||
+           query.to != std::numeric_limits<int64_t>::max();
+}
+
+/**
+ * @brief run
+ * @return false if any task failed
+ *
+ * Workers take tasks in file order, output is printed in the same order. Workers stay at most
+ * `window` tasks ahead of output, so memory does not grow with file size.
+ */
+bool run(const std::vector<Task> &tasks, const Query &query, size_t jobs) {
+    std::vector<Result> results(tasks.size());
+    const size_t window = jobs * 4;
+    std::mutex mutex;
+    std::condition_variable changed;
+    size_t next = 0;
+    size_t printed = 0;
+
+    auto work = [&] {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            changed.wait(lock, [&] { return next >= tasks.size() || next < printed + window; });
+            if (next >= tasks.size()) {
+                return;
+            }
+            size_t idx = next++;
+            lock.unlock();
+            runTask(tasks[idx], query, results[idx]);
+            lock.lock();
+            results[idx].done = true;
+            changed.notify_all();
+        }
+    };
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < jobs; ++i) {
+        workers.emplace_back(work);
+    }
+
+    bool ok = true;
+    size_t partial = 0;
+    for (size_t idx = 0; idx < tasks.size(); ++idx) {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&] { return results[idx].done; });
+        lock.unlock();
+
+        Result &result = results[idx];
+        std::fwrite(result.out.data(), 1, result.out.size(), stdout);
+        if (tasks[idx].partial && !result.out.empty()) {
+            ++partial;
+        }
+        if (!result.error.empty()) {
+            std::fprintf(stderr, "cpplog-query: %s: %s\n", tasks[idx].path,
+                         result.error.c_str());
+            ok = false;
+        }
+        result = Result();
+
+        lock.lock();
+        printed = idx + 1;
+        changed.notify_all();
+    }
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+    if (partial != 0 && hasTimeRange(query)) {
+        std::fprintf(stderr,
+                     "cpplog-query: %zu blocks partly outside time range were printed whole\n",
+                     partial);
+    }
+    return ok;
+}
+
+/**
+ * @brief parseTime
+ * @param end true for the end of range, omitted seconds mean the end of minute
+ *
+ * Accepts number in units of context provider or local time "YYYY-MM-DD HH:MM[:SS]",
+ * "YYYY-MM-DDTHH:MM[:SS]", "HH:MM[:SS]" (today) converted to seconds since epoch.
+ */
+bool parseTime(const char *arg, bool end, int64_t &out) {
+    char *num_end = nullptr;
+    long long value = std::strtoll(arg, &num_end, 10);
+    if (num_end != arg && *num_end == '\0') {
+        out = value;
+        return true;
+    }
+
+    std::time_t now = std::time(nullptr);
+    std::tm datetime = *std::localtime(&now);
+    int sec = -1;
+    char sep = 0;
+    int fields = std::sscanf(arg, "%d-%d-%d%c%d:%d:%d", &datetime.tm_year, &datetime.tm_mon,
+                             &datetime.tm_mday, &sep, &datetime.tm_hour, &datetime.tm_min, &sec);
+    if (fields >= 6 && (sep == ' ' || sep == 'T')) {
+        datetime.tm_year -= 1900;
+        datetime.tm_mon -= 1;
+    } else {
+        sec = -1;
+        fields = std::sscanf(arg, "%d:%d:%d", &datetime.tm_hour, &datetime.tm_min, &sec);
+        if (fields < 2) {
+            return false;
+        }
+    }
+    datetime.tm_sec = sec < 0 ? (end ? 59 : 0) : sec;
+    datetime.tm_isdst = -1;
+    std::time_t time = std::mktime(&datetime);
+    if (time == static_cast<std::time_t>(-1)) {
+        return false;
+    }
+    out = static_cast<int64_t>(time);
+    return true;
+}
+
+bool parseLevels(const char *arg, uint32_t &levels) {
+    levels = 0;
+    std::string_view rest(arg);
+    while (!rest.empty()) {
+        size_t comma = rest.find(',');
+        std::string name(rest.substr(0, comma));
+        std::transform(name.begin(), name.end(), name.begin(),
+                       [](char c) { return static_cast<char>(std::toupper(c)); });
+        auto it = std::find(msg_log_types.begin(), msg_log_types.end(), name);
+        if (it == msg_log_types.end()) {
+            return false;
+        }
+        levels |= 1U << static_cast<unsigned>(it - msg_log_types.begin());
+        rest.remove_prefix(comma == std::string_view::npos ? rest.size() : comma + 1);
+    }
+    return levels != 0;
+}
+
+int usage() {
+    std::fprintf(stderr,
+                 "usage: cpplog-query [-f FROM] [-t TO] [-l LEVEL[,LEVEL...]] [-g TEXT] [-j JOBS] "
+                 "FILE...\n"
+                 "  FROM, TO  timestamp or local time \"YYYY-MM-DD HH:MM[:SS]\", \"HH:MM[:SS]\",\n"
+                 "            checked per index block, blocks partly in range are printed whole\n"
+                 "  LEVEL     FATAL, ERROR, WARN, INFO, DEBUG\n");
+    return 2;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    Query query;
+    size_t jobs = std::max(1U, std::thread::hardware_concurrency());
+    std::vector<const char *> files;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg(argv[i]);
+        if (arg.size() != 2 || arg[0] != '-') {
+            files.push_back(argv[i]);
+            continue;
+        }
+        if (i + 1 >= argc) {
+            return usage();
+        }
+        const char *value = argv[++i];
+        bool ok = true;
+        switch (arg[1]) {
+            case 'f':
+                ok = parseTime(value, false, query.from);
+                break;
+            case 't':
+                ok = parseTime(value, true, query.to);
+                break;
+            case 'l':
+                ok = parseLevels(value, query.levels);
+                break;
+            case 'g':
+                query.text = value;
+                break;
+            case 'j':
+                jobs = std::strtoul(value, nullptr, 10);
+                ok = jobs != 0;
+                break;
+            default:
+                ok = false;
+        }
+        if (!ok) {
+            std::fprintf(stderr, "cpplog-query: invalid value of %s: %s\n", argv[i - 1], value);
+            return usage();
+        }
+    }
+    if (files.empty()) {
+        return usage();
+    }
+
+    bool ok = true;
+    std::vector<Task> tasks;
+    for (const char *path : files) {
+        ok = planFile(path, query, tasks) && ok;
+    }
+    ok = run(tasks, query, jobs) && ok;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,101 @@
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/**
+ * cpplog-recv: minimal local log collector for `Log::UnixSocketSink`. Listens on `AF_UNIX`
+ * stream (default) or datagram socket and writes everything it receives to stdout.
+ */
+
+static volatile std::sig_atomic_t stop_requested = 0;
+
+static void onSignal(int) {
+    stop_requested = 1;
+}
+
+static int bindSocket(const char *path, int type) {
+    int sock = socket(AF_UNIX, type, 0);
+    if (sock < 0) {
+        return -1;
+    }
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    unlink(path);
+    if (bind(sock, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) != 0 ||
+        (type == SOCK_STREAM && listen(sock, 16) != 0)) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+int main(int argc, char **argv) {
+    int type = SOCK_STREAM;
+    const char *path = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "-d") == 0) {
+            type = SOCK_DGRAM;
+        } else {
+            path = argv[i];
+        }
+    }
+    if (path == nullptr) {
+        std::fprintf(stderr, "usage: cpplog-recv [-d] SOCKET_PATH\n");
+        return 2;
+    }
+
+    int sock = bindSocket(path, type);
+    if (sock < 0) {
+        std::fprintf(stderr, "cpplog-recv: %s: %s\n", path, std::strerror(errno));
+        return 1;
+    }
+    std::signal(SIGINT, onSignal);
+    std::signal(SIGTERM, onSignal);
+
+    // the first entry is listening or datagram socket, others are connected clients
+    std::vector<pollfd> fds = {{sock, POLLIN, 0}};
+    std::vector<char> buf(256 * 1024);
+
+    while (stop_requested == 0) {
+        if (poll(fds.data(), fds.size(), 200) <= 0) {
+            continue;
+        }
+        for (size_t i = 0; i < fds.size(); ++i) {
+            if ((fds[i].revents & (POLLIN | POLLHUP | POLLERR)) == 0) {
+                continue;
+            }
+            if (i == 0 && type == SOCK_STREAM) {
+                int client = accept(sock, nullptr, nullptr);
+                if (client >= 0) {
+                    fds.push_back({client, POLLIN, 0});
+                }
+                continue;
+            }
+            ssize_t len = recv(fds[i].fd, buf.data(), buf.size(), 0);
+            if (len > 0) {
+                std::fwrite(buf.data(), 1, static_cast<size_t>(len), stdout);
+            } else if (i != 0 && (len == 0 || errno != EINTR)) {
+                close(fds[i].fd);
+                fds[i].fd = -1;
+            }
+        }
+        std::fflush(stdout);
+        auto closed = [](const pollfd &p) { return p.fd < 0; };
+        fds.erase(std::remove_if(fds.begin() + 1, fds.end(), closed), fds.end());
+    }
+
+    for (const pollfd &p : fds) {
+        close(p.fd);
+    }
+    unlink(path);
+    return 0;
+}